@@ -0,0 +1,213 @@
+// Bounded producer/consumer queues.
+//
+// Each queue is a ring of ints in a kalloc'd page, protected
+// by a sleep lock, with condition variables for the full and
+// empty cases.  produce_many/consume_many copy whole spans of
+// the ring to and from user space with a single copyin/copyout,
+// so the per-item cost is a memory copy, not a system call.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "condvar.h"
+#include "proc.h"
+#include "defs.h"
+#include "bqueue.h"
+
+struct bqueue {
+  int used;               // allocated by bqueue_alloc()?
+  uint cap;               // capacity in items
+  uint head;              // next slot to consume
+  uint tail;              // next slot to produce
+  uint count;             // items currently queued
+  int nwait;              // processes sleeping on the queue
+  int *buf;               // ring of cap items
+  struct sleeplock lock;  // protects everything above
+  struct cond_t notfull;  // signalled when items are consumed
+  struct cond_t notempty; // signalled when items are produced
+};
+
+static struct {
+  struct spinlock lock;   // protects bq[].used during alloc/free
+  struct bqueue bq[NBQUEUE];
+} bqtable;
+
+void
+bqueueinit(void)
+{
+  struct bqueue *q;
+
+  initlock(&bqtable.lock, "bqtable");
+  for(q = bqtable.bq; q < &bqtable.bq[NBQUEUE]; q++)
+    initsleeplock(&q->lock, "bqueue");
+}
+
+// Allocate a queue holding up to cap items.
+// Returns the queue id, or -1.
+int
+bqueue_alloc(int cap)
+{
+  struct bqueue *q;
+  int *buf;
+
+  if(cap <= 0 || cap > BQ_MAXCAP)
+    return -1;
+  if((buf = (int*)kalloc()) == 0)
+    return -1;
+
+  acquire(&bqtable.lock);
+  for(q = bqtable.bq; q < &bqtable.bq[NBQUEUE]; q++){
+    if(!q->used){
+      q->buf = buf;
+      q->cap = cap;
+      q->head = q->tail = q->count = 0;
+      q->nwait = 0;
+      q->used = 1;
+      release(&bqtable.lock);
+      return q - bqtable.bq;
+    }
+  }
+  release(&bqtable.lock);
+  kfree((void*)buf);
+  return -1;
+}
+
+// Look up queue id and return it with its lock held,
+// or 0 if id does not name an allocated queue.
+static struct bqueue*
+bqueue_lock(int id)
+{
+  struct bqueue *q;
+
+  if(id < 0 || id >= NBQUEUE)
+    return 0;
+  q = &bqtable.bq[id];
+  acquiresleep(&q->lock);
+  if(!q->used){
+    releasesleep(&q->lock);
+    return 0;
+  }
+  return q;
+}
+
+// Free queue id.  Fails if a process is still
+// sleeping on it.
+int
+bqueue_free(int id)
+{
+  struct bqueue *q;
+  int *buf;
+
+  if((q = bqueue_lock(id)) == 0)
+    return -1;
+  if(q->nwait > 0){
+    releasesleep(&q->lock);
+    return -1;
+  }
+  buf = q->buf;
+  q->buf = 0;
+  acquire(&bqtable.lock);
+  q->used = 0;
+  release(&bqtable.lock);
+  releasesleep(&q->lock);
+  kfree((void*)buf);
+  return 0;
+}
+
+// Append n ints from user address addr to queue id.
+// Sleeps while the queue is full unless BQ_NONBLOCK is set,
+// in which case only the items that fit are taken.
+// Returns the number of items produced, or -1 if none
+// were and the process was killed or addr is bad.
+int
+bqueue_produce(int id, uint64 addr, int n, int flags)
+{
+  struct bqueue *q;
+  struct proc *p = myproc();
+  uint span;
+  int done = 0;
+
+  if(n < 0 || (q = bqueue_lock(id)) == 0)
+    return -1;
+  while(done < n){
+    if(p->killed){
+      if(done == 0)
+        done = -1;
+      break;
+    }
+    if(q->count == q->cap){
+      if(flags & BQ_NONBLOCK)
+        break;
+      q->nwait++;
+      cond_wait(&q->notfull, &q->lock);
+      q->nwait--;
+      continue;
+    }
+    // largest run that fits without wrapping the ring.
+    span = n - done;
+    if(span > q->cap - q->count)
+      span = q->cap - q->count;
+    if(span > q->cap - q->tail)
+      span = q->cap - q->tail;
+    if(copyin(p->pagetable, (char*)&q->buf[q->tail],
+              addr + done*sizeof(int), span*sizeof(int)) < 0){
+      if(done == 0)
+        done = -1;
+      break;
+    }
+    q->tail = (q->tail + span) % q->cap;
+    q->count += span;
+    done += span;
+    cond_broadcast(&q->notempty);
+  }
+  releasesleep(&q->lock);
+  return done;
+}
+
+// Remove up to n ints from queue id into user address addr.
+// Sleeps until at least one item is queued unless BQ_NONBLOCK
+// is set.  Returns the number of items consumed, or -1 if
+// none were and the process was killed or addr is bad.
+int
+bqueue_consume(int id, uint64 addr, int n, int flags)
+{
+  struct bqueue *q;
+  struct proc *p = myproc();
+  uint span;
+  int done = 0;
+
+  if(n < 0 || (q = bqueue_lock(id)) == 0)
+    return -1;
+  while(n > 0 && q->count == 0){
+    if(p->killed || (flags & BQ_NONBLOCK)){
+      releasesleep(&q->lock);
+      return p->killed ? -1 : 0;
+    }
+    q->nwait++;
+    cond_wait(&q->notempty, &q->lock);
+    q->nwait--;
+  }
+  while(done < n && q->count > 0){
+    span = n - done;
+    if(span > q->count)
+      span = q->count;
+    if(span > q->cap - q->head)
+      span = q->cap - q->head;
+    if(copyout(p->pagetable, addr + done*sizeof(int),
+               (char*)&q->buf[q->head], span*sizeof(int)) < 0){
+      if(done == 0)
+        done = -1;
+      break;
+    }
+    q->head = (q->head + span) % q->cap;
+    q->count -= span;
+    done += span;
+  }
+  if(done != 0)
+    cond_broadcast(&q->notfull);
+  releasesleep(&q->lock);
+  return done;
+}
@@ -0,0 +1,6 @@
+// Bounded queues of ints shared between processes.
+// Items are moved in batches by produce_many()/consume_many(),
+// so one system call can transfer a whole array.
+#define NBQUEUE      10    // maximum number of queues
+#define BQ_MAXCAP    1024  // max items per queue (one page of ints)
+#define BQ_NONBLOCK  0x1   // don't sleep; transfer what fits and return
@@ -21,6 +21,7 @@
 #include "riscv.h"
 #include "defs.h"
 #include "proc.h"
+#include "iovec.h"
 
 #define BACKSPACE 0x100
 #define C(x)  ((x)-'@')  // Control-x
@@ -58,13 +59,17 @@ struct {
 int
 consolewrite(int user_src, uint64 src, int n)
 {
-  int i;
-
-  for(i = 0; i < n; i++){
-    char c;
-    if(either_copyin(&c, user_src, src+i, 1) == -1)
+  int i, j, m;
+  char buf[64];
+
+  for(i = 0; i < n; i += m){
+    m = n - i;
+    if(m > sizeof(buf))
+      m = sizeof(buf);
+    if(either_copyin(buf, user_src, src+i, m) == -1)
       break;
-    uartputc(c);
+    for(j = 0; j < m; j++)
+      uartputc(buf[j]);
   }
 
   return i;
@@ -80,8 +85,8 @@ int
 consoleread(int user_dst, uint64 dst, int n)
 {
   uint target;
-  int c;
-  char cbuf;
+  int c, m, niov;
+  struct iovec iov[2];
 
   target = n;
   acquire(&cons.lock);
@@ -96,25 +101,32 @@ consoleread(int user_dst, uint64 dst, int n)
       sleep(&cons.r, &cons.lock);
     }
 
-    c = cons.buf[cons.r++ % INPUT_BUF];
+    // the input up to a newline (included), a ^D (not
+    // included), or n bytes, whichever comes first.
+    for(m = 0, c = 0; m < n && cons.r + m != cons.w && c != '\n'; m++){
+      c = cons.buf[(cons.r + m) % INPUT_BUF];
+      if(c == C('D'))
+        break;
+    }
+
+    // copy it to the user-space buffer.
+    niov = ringiov(cons.buf, INPUT_BUF, cons.r, m, iov);
+    if(either_copyoutv(user_dst, dst, iov, niov) == -1)
+      break;
+    cons.r += m;
+    dst += m;
+    n -= m;
 
     if(c == C('D')){  // end-of-file
-      if(n < target){
-        // Save ^D for next time, to make sure
-        // caller gets a 0-byte result.
-        cons.r--;
+      if(n == target){
+        // consume the ^D.  otherwise save it for
+        // next time, to make sure caller gets a
+        // 0-byte result.
+        cons.r++;
       }
       break;
     }
 
-    // copy the input byte to the user-space buffer.
-    cbuf = c;
-    if(either_copyout(user_dst, dst, &cbuf, 1) == -1)
-      break;
-
-    dst++;
-    --n;
-
     if(c == '\n'){
       // a whole line has arrived, return to
       // the user-level read().
@@ -141,6 +153,15 @@ consoleintr(int c)
   case C('P'):  // Print process list.
     procdump();
     break;
+  case C('L'):  // Print lock contention counters.
+    lockdump();
+    break;
+  case C('F'):  // Print free memory counters.
+    kallocdump();
+    slabdump();
+    vmdump();
+    swapdump();
+    break;
   case C('U'):  // Kill line.
     while(cons.e != cons.w &&
           cons.buf[(cons.e-1) % INPUT_BUF] != '\n'){
@@ -9,7 +9,13 @@ struct sleeplock;
 struct stat;
 struct superblock;
 struct cond_t;
+struct rwspinlock;
+struct slab_cache;
+struct rwsleeplock;
 struct sem_t;
+struct lockstat;
+struct iovec;
+struct procstat;
 
 // bio.c
 void            binit(void);
@@ -26,6 +32,12 @@ void            consputc(int);
 
 // exec.c
 int             exec(char*, char**);
+int             execproc(struct proc*, char*, char**);
+int             execfault(struct proc*, uint64, char**, int*);
+void            execfork(struct proc*, struct proc*);
+void            execrelease(struct proc*);
+void            textinit(void);
+void            textfree(struct inode*);
 
 // file.c
 struct file*    filealloc(void);
@@ -65,6 +77,16 @@ void            ramdiskrw(struct buf*);
 void*           kalloc(void);
 void            kfree(void *);
 void            kinit(void);
+void            kallocdump(void);
+void*           kalloc_zeroed(void);
+void*           kalloc_order(int);
+void            kfree_order(void*, int);
+void            kdrain(void);
+void            krefinc(void*);
+int             krefcount(void*);
+int             kfreecount(void);
+int             ktotalcount(void);
+void            kzeroidle(void);
 
 // log.c
 void            initlog(int, struct superblock*);
@@ -73,6 +95,7 @@ void            begin_op(void);
 void            end_op(void);
 
 // pipe.c
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, uint64, int);
@@ -88,10 +111,11 @@ int             cpuid(void);
 void            exit(int);
 int             fork(void);
 int             growproc(int);
-void            proc_mapstacks(pagetable_t);
+struct proc*    procnext(struct proc*);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
 int             kill(int);
+void            kthread(char*, void (*)(void));
 struct cpu*     mycpu(void);
 struct cpu*     getmycpu(void);
 struct proc*    myproc();
@@ -105,15 +129,20 @@ void            wakeup(void*);
 void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
+int             either_copyoutv(int, uint64, struct iovec*, int);
+int             either_copyinv(struct iovec*, int, int, uint64);
 void            procdump(void);
 int		forkf(uint64);
 int		waitpid(int, uint64);
 int		ps(void);
 int		pinfo(int, uint64);
 int		forkp(int);
+int		spawn(char*, char**, int);
 int		schedpolicy(int);
 void    condsleep(struct cond_t*,struct sleeplock*);
 void    wakeupone(void*);
+extern struct rwspinlock wait_lock;
+extern int nproc;
 
 // swtch.S
 void            swtch(struct context*, struct context*);
@@ -122,16 +151,54 @@ void            swtch(struct context*, struct context*);
 void            acquire(struct spinlock*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
+void            initticketlock(struct spinlock*, char*);
+void            lockdump(void);
+struct lockstat* lockstat_lookup(char*, int);
+void            lockstat_acquired(struct lockstat*, int, uint64, uint64);
+void            lockstat_released(struct lockstat*, uint64);
+int             lockstat_copyout(uint64, int);
 void            release(struct spinlock*);
 void            push_off(void);
 void            pop_off(void);
 
+// slab.c
+void            slab_cache_init(struct slab_cache*, char*, uint, void (*)(void*));
+void*           slab_alloc(struct slab_cache*);
+void            slab_free(struct slab_cache*, void*);
+void            slabdump(void);
+
+// swap.c
+void            swapinit(uint, uint);
+void            swapd(void);
+void            swapthrottle(void);
+int             swaprescue(pte_t*);
+int             swapfault(struct proc*, pte_t*);
+void            swapunmap(pte_t*, int);
+pte_t           swapdup(pte_t);
+void            swapdump(void);
+void            swapcount(int*, int*);
+
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
 
+// rwlock.c
+void            initrwlock(struct rwspinlock*, char*);
+void            acquireread(struct rwspinlock*);
+void            releaseread(struct rwspinlock*);
+void            acquirewrite(struct rwspinlock*);
+void            releasewrite(struct rwspinlock*);
+int             holdingwrite(struct rwspinlock*);
+void            sleepread(void*, struct rwspinlock*);
+void            initrwsleeplock(struct rwsleeplock*, char*);
+void            acquirereadsleep(struct rwsleeplock*);
+void            releasereadsleep(struct rwsleeplock*);
+void            acquirewritesleep(struct rwsleeplock*);
+void            releasewritesleep(struct rwsleeplock*);
+int             holdingwritesleep(struct rwsleeplock*);
+
 // condvar.c
 void            cond_wait (struct cond_t*, struct sleeplock*);
 void            cond_signal (struct cond_t*);
@@ -142,6 +209,32 @@ void            sem_init(struct sem_t*,int);
 void            sem_wait(struct sem_t*);
 void            sem_post(struct sem_t*);
 
+// mmap.c
+uint64          mmap(uint64, int, int, struct file*, uint);
+int             mmapfault(struct proc*, uint64, int);
+int             munmap(uint64, uint64);
+int             mmapshare(struct proc*);
+int             mmapfork(struct proc*, struct proc*);
+void            mmaprelease(struct proc*);
+
+// shm.c
+void            shminit(void);
+int             shmget(int, int);
+uint64          shmat(int);
+int             shmdt(uint64);
+int             shmfork(struct proc*, struct proc*);
+void            shmrelease(struct proc*);
+void            shmdisown(struct proc*);
+int             futex_wait(uint64, int);
+int             futex_wake(uint64);
+
+// bqueue.c
+void            bqueueinit(void);
+int             bqueue_alloc(int);
+int             bqueue_free(int);
+int             bqueue_produce(int, uint64, int, int);
+int             bqueue_consume(int, uint64, int, int);
+
 
 // string.c
 int             memcmp(const void*, const void*, uint);
@@ -178,19 +271,35 @@ int             uartgetc(void);
 void            kvminit(void);
 void            kvminithart(void);
 void            kvmmap(pagetable_t, uint64, uint64, uint64, int);
+int             kvminitstack(uint64, int);
+int             kvmallocstack(uint64, int);
+void            kvmfreestack(uint64, int);
+void            kvmsync(void);
 int             mappages(pagetable_t, uint64, uint64, uint64, int);
 pagetable_t     uvmcreate(void);
 void            uvminit(pagetable_t, uchar *, uint);
 uint64          uvmalloc(pagetable_t, uint64, uint64);
 uint64          uvmdealloc(pagetable_t, uint64, uint64);
 int             uvmcopy(pagetable_t, pagetable_t, uint64);
+int             uvmcopyrange(pagetable_t, pagetable_t, uint64, uint64, int);
+int             mapmegapage(pagetable_t, uint64, uint64, int);
+void            vmdump(void);
+void            asidalloc(struct proc*);
+uint64          uvmactivate(struct proc*);
+int             cowfault(pagetable_t, uint64);
+int             vmfault(struct proc*, uint64, int);
+void            uvmprefault(uint64, uint64, int);
 void            uvmfree(pagetable_t, uint64);
+void            uvmstat(pagetable_t, struct procstat*);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
+pte_t*          walk(pagetable_t, uint64, int);
 uint64          walkaddr(pagetable_t, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
 int             copyinstr(pagetable_t, char *, uint64, uint64);
+int             copyoutv(pagetable_t, uint64, struct iovec*, int);
+int             copyinv(pagetable_t, struct iovec*, int, uint64);
 
 // plic.c
 void            plicinit(void);
@@ -3,23 +3,95 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
+#include "fs.h"
+#include "file.h"
+#include "slab.h"
 #include "defs.h"
 #include "elf.h"
 
-static int loadseg(pde_t *pgdir, uint64 addr, struct inode *ip, uint offset, uint sz);
+// Programs are demand paged: exec() only records the ELF
+// segments and a reference to the program's inode in the
+// process, and execfault() reads each page from the file the
+// first time it is touched.  Segments that are not writable
+// (text) are mapped read-only, so fork() shares them.
+//
+// Read-only pages are also kept on a list in the program's
+// inode, holding a kalloc() reference, so every process that
+// runs the same program maps the same physical pages and a
+// second exec() of a hot binary reads nothing from disk.  The
+// list is protected by the inode's lock and is dropped when the
+// file is written or truncated, or the inode leaves the cache.
+//
+// Since pages are read long after exec(), a program file can't
+// be written or truncated while a process runs it: ip->nexec
+// counts those processes, and writers check it with the inode
+// locked.  It is changed atomically, since fork() can't sleep
+// for the inode's lock.
+
+struct textpage {
+  uint64 va;              // user address the page is mapped at
+  char *pa;
+  struct textpage *next;
+};
+
+static struct slab_cache textcache;
+
+void
+textinit(void)
+{
+  slab_cache_init(&textcache, "textpage", sizeof(struct textpage), 0);
+}
+
+// Drop a running process's claim on program file ip.
+// Caller must be inside a transaction.
+static void
+execput(struct inode *ip)
+{
+  __sync_fetch_and_sub(&ip->nexec, 1);
+  iput(ip);
+}
+
+// Drop ip's cached text pages.  Processes that have
+// them mapped keep their own references.
+// Caller must hold ip->lock, or ip must be unreferenced.
+void
+textfree(struct inode *ip)
+{
+  struct textpage *t;
+
+  while((t = ip->text) != 0){
+    ip->text = t->next;
+    kfree(t->pa);
+    slab_free(&textcache, t);
+  }
+}
 
 int
 exec(char *path, char **argv)
+{
+  return execproc(myproc(), path, argv);
+}
+
+// Replace p's user memory with the program in path, with
+// arguments argv (kernel strings), and set its registers to
+// start main().  p is the caller, for exec(), or a new
+// process that has not yet run, for spawn().  path is looked
+// up relative to the caller's directory.
+// Returns argc, or -1 leaving p unchanged.
+int
+execproc(struct proc *p, char *path, char **argv)
 {
   char *s, *last;
   int i, off;
   uint64 argc, sz = 0, sp, ustack[MAXARG], stackbase;
   struct elfhdr elf;
-  struct inode *ip;
+  struct inode *ip, *oldip;
   struct proghdr ph;
+  struct execseg seg[NEXECSEG];
+  int nseg = 0, locked;
   pagetable_t pagetable = 0, oldpagetable;
-  struct proc *p = myproc();
 
   begin_op();
 
@@ -28,6 +100,7 @@ exec(char *path, char **argv)
     return -1;
   }
   ilock(ip);
+  locked = 1;
 
   // Check ELF header
   if(readi(ip, 0, (uint64)&elf, 0, sizeof(elf)) != sizeof(elf))
@@ -38,7 +111,7 @@ exec(char *path, char **argv)
   if((pagetable = proc_pagetable(p)) == 0)
     goto bad;
 
-  // Load program into memory.
+  // Record the program's segments; execfault() loads them.
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(readi(ip, 0, (uint64)&ph, off, sizeof(ph)) != sizeof(ph))
       goto bad;
@@ -48,20 +121,29 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr + ph.memsz < ph.vaddr)
       goto bad;
-    uint64 sz1;
-    if((sz1 = uvmalloc(pagetable, sz, ph.vaddr + ph.memsz)) == 0)
+    if(ph.vaddr + ph.memsz > MMAPBASE)
       goto bad;
-    sz = sz1;
     if((ph.vaddr % PGSIZE) != 0)
       goto bad;
-    if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    if(ph.off + ph.filesz < ph.off)
+      goto bad;
+    if(nseg >= NEXECSEG)
       goto bad;
+    seg[nseg].vaddr = ph.vaddr;
+    seg[nseg].memsz = ph.memsz;
+    seg[nseg].off = ph.off;
+    seg[nseg].filesz = ph.filesz;
+    seg[nseg].flags = ph.flags;
+    nseg++;
+    if(ph.vaddr + ph.memsz > sz)
+      sz = ph.vaddr + ph.memsz;
   }
-  iunlockput(ip);
+  // from here on ip is a running program.
+  __sync_fetch_and_add(&ip->nexec, 1);
+  iunlock(ip);
   end_op();
-  ip = 0;
+  locked = 0;
 
-  p = myproc();
   uint64 oldsz = p->sz;
 
   // Allocate two pages at the next page boundary.
@@ -109,12 +191,26 @@ exec(char *path, char **argv)
   safestrcpy(p->name, last, sizeof(p->name));
     
   // Commit to the user image.
+  mmaprelease(p);
+  shmrelease(p);
+  acquire(&p->lock); // the page reclaimer checks p->pagetable under it
   oldpagetable = p->pagetable;
   p->pagetable = pagetable;
+  release(&p->lock);
+  p->tlbflush = 1; // the ASID's entries are for the old image
   p->sz = sz;
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
   proc_freepagetable(oldpagetable, oldsz);
+  oldip = p->execip;
+  p->execip = ip;
+  memmove(p->seg, seg, sizeof(seg));
+  p->nseg = nseg;
+  if(oldip){
+    begin_op();
+    execput(oldip);
+    end_op();
+  }
 
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
@@ -122,33 +218,116 @@ exec(char *path, char **argv)
   if(pagetable)
     proc_freepagetable(pagetable, sz);
   if(ip){
-    iunlockput(ip);
+    if(locked){
+      iunlockput(ip);
+    } else {
+      begin_op();
+      execput(ip);
+    }
     end_op();
   }
   return -1;
 }
 
-// Load a program segment into pagetable at virtual address va.
-// va must be page-aligned
-// and the pages from va to va+sz must already be mapped.
-// Returns 0 on success, -1 on failure.
-static int
-loadseg(pagetable_t pagetable, uint64 va, struct inode *ip, uint offset, uint sz)
+// Find the page for address va of p's program image: the
+// parts of the page inside segments come from the program's
+// inode, the rest is zero.  Read-only pages are shared through
+// the inode's text cache.  va must be page-aligned and below
+// p->sz.  Sets *mem to a page the caller owns a reference to
+// and *perm to the PTE permissions it should get.  Returns 0
+// on success, 1 if va is not in any segment (it is heap), or
+// -1 if out of memory or the file is short.
+int
+execfault(struct proc *p, uint64 va, char **memp, int *perm)
 {
-  uint i, n;
-  uint64 pa;
-
-  for(i = 0; i < sz; i += PGSIZE){
-    pa = walkaddr(pagetable, va + i);
-    if(pa == 0)
-      panic("loadseg: address should exist");
-    if(sz - i < PGSIZE)
-      n = sz - i;
-    else
-      n = PGSIZE;
-    if(readi(ip, 0, (uint64)pa, offset+i, n) != n)
+  struct inode *ip = p->execip;
+  struct execseg *s;
+  struct textpage *t;
+  uint64 start, end, n;
+  char *mem;
+  int found = 0;
+
+  *perm = PTE_U;
+  for(s = p->seg; s < &p->seg[p->nseg]; s++){
+    if(va + PGSIZE <= s->vaddr || va >= s->vaddr + s->memsz)
+      continue;
+    found = 1;
+    *perm |= PTE_R;
+    if(s->flags & ELF_PROG_FLAG_WRITE)
+      *perm |= PTE_W;
+    if(s->flags & ELF_PROG_FLAG_EXEC)
+      *perm |= PTE_X;
+  }
+  if(!found)
+    return 1;
+
+  ilock(ip);
+  if((*perm & PTE_W) == 0){
+    for(t = ip->text; t; t = t->next){
+      if(t->va == va){
+        krefinc(t->pa);
+        iunlock(ip);
+        *memp = t->pa;
+        return 0;
+      }
+    }
+  }
+
+  if((mem = kalloc()) == 0){
+    iunlock(ip);
+    return -1;
+  }
+  memset(mem, 0, PGSIZE);
+  for(s = p->seg; s < &p->seg[p->nseg]; s++){
+    // the part of the page backed by the file.
+    start = va > s->vaddr ? va : s->vaddr;
+    end = va + PGSIZE;
+    if(end > s->vaddr + s->filesz)
+      end = s->vaddr + s->filesz;
+    if(start >= end)
+      continue;
+    n = end - start;
+    if(readi(ip, 0, (uint64)mem + (start - va),
+             s->off + (start - s->vaddr), n) != n){
+      iunlock(ip);
+      kfree(mem);
       return -1;
+    }
   }
-  
+  if((*perm & PTE_W) == 0 && (t = slab_alloc(&textcache)) != 0){
+    t->va = va;
+    t->pa = mem;
+    krefinc(mem);
+    t->next = ip->text;
+    ip->text = t;
+  }
+  iunlock(ip);
+  *memp = mem;
   return 0;
 }
+
+// Give child np a reference to p's program file.
+void
+execfork(struct proc *p, struct proc *np)
+{
+  if(p->execip){
+    np->execip = idup(p->execip);
+    __sync_fetch_and_add(&np->execip->nexec, 1);
+  }
+  memmove(np->seg, p->seg, sizeof(p->seg));
+  np->nseg = p->nseg;
+}
+
+// Drop p's reference to its program file.
+// Called from exit(); may sleep.
+void
+execrelease(struct proc *p)
+{
+  if(p->execip == 0)
+    return;
+  begin_op();
+  execput(p->execip);
+  end_op();
+  p->execip = 0;
+  p->nseg = 0;
+}
@@ -18,6 +18,8 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  int nexec;          // Processes running it; it can't be written (exec.c)
+  struct inode *next; // on itable.inodes
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
@@ -27,6 +29,7 @@ struct inode {
   short nlink;
   uint size;
   uint addrs[NDIRECT+1];
+  struct textpage *text; // cached read-only program pages; see exec.c
 };
 
 // map major device number to device functions.
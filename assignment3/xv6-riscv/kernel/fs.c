@@ -20,6 +20,7 @@
 #include "fs.h"
 #include "buf.h"
 #include "file.h"
+#include "slab.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 // there should be one superblock per disk device, but we run with
@@ -44,6 +45,7 @@ fsinit(int dev) {
   if(sb.magic != FSMAGIC)
     panic("invalid file system");
   initlog(dev, &sb);
+  swapinit(sb.swapstart, sb.nswap);
 }
 
 // Zero a block.
@@ -167,24 +169,35 @@ bfree(int dev, uint b)
 // and ip->dev and ip->inum indicate which i-node an entry
 // holds, one must hold itable.lock while using any of those fields.
 //
+// In-memory inodes come from a slab cache and are kept on the
+// itable.inodes list.  Up to NINODE inodes with no references
+// stay on the list so that a later iget() finds them still
+// valid.  The last iput() moves an inode to the front of the
+// list, so the unreferenced inode furthest back is the least
+// recently used, and is the one freed to make room.
+//
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
 struct {
   struct spinlock lock;
-  struct inode inode[NINODE];
+  struct inode *inodes;   // every in-memory inode
+  int nunused;            // how many of them have ref == 0
+  struct slab_cache cache;
 } itable;
 
+static void
+inodector(void *obj)
+{
+  initsleeplock(&((struct inode*)obj)->lock, "inode");
+}
+
 void
 iinit()
 {
-  int i = 0;
-  
   initlock(&itable.lock, "itable");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&itable.inode[i].lock, "inode");
-  }
+  slab_cache_init(&itable.cache, "inode", sizeof(struct inode), inodector);
 }
 
 static struct inode* iget(uint dev, uint inum);
@@ -198,16 +211,21 @@ ialloc(uint dev, short type)
   int inum;
   struct buf *bp;
   struct dinode *dip;
+  struct inode *ip;
 
   for(inum = 1; inum < sb.ninodes; inum++){
     bp = bread(dev, IBLOCK(inum, sb));
     dip = (struct dinode*)bp->data + inum%IPB;
     if(dip->type == 0){  // a free inode
+      if((ip = iget(dev, inum)) == 0){
+        brelse(bp);
+        return 0;
+      }
       memset(dip, 0, sizeof(*dip));
       dip->type = type;
       log_write(bp);   // mark it allocated on the disk
       brelse(bp);
-      return iget(dev, inum);
+      return ip;
     }
     brelse(bp);
   }
@@ -236,37 +254,62 @@ iupdate(struct inode *ip)
   brelse(bp);
 }
 
+static void ifree(struct inode *ip);
+
+// Free the least recently used unreferenced inode.
+// Returns 0 if there is none.
+// Caller must hold itable.lock.
+static int
+ievict(void)
+{
+  struct inode *ip, *lru = 0;
+
+  for(ip = itable.inodes; ip; ip = ip->next)
+    if(ip->ref == 0)
+      lru = ip;
+  if(lru == 0)
+    return 0;
+  itable.nunused--;
+  ifree(lru);
+  return 1;
+}
+
 // Find the inode with number inum on device dev
 // and return the in-memory copy. Does not lock
 // the inode and does not read it from disk.
+// Returns 0 if out of memory.
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip;
 
   acquire(&itable.lock);
 
   // Is the inode already in the table?
-  empty = 0;
-  for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
+  for(ip = itable.inodes; ip; ip = ip->next){
+    if(ip->dev == dev && ip->inum == inum){
+      if(ip->ref++ == 0)
+        itable.nunused--;
       release(&itable.lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
   }
 
-  // Recycle an inode entry.
-  if(empty == 0)
-    panic("iget: no inodes");
-
-  ip = empty;
+  // Allocate a new entry, reusing a cached one if need be.
+  while((ip = slab_alloc(&itable.cache)) == 0){
+    if(!ievict()){
+      release(&itable.lock);
+      return 0;
+    }
+  }
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
+  ip->nexec = 0;
   ip->valid = 0;
+  ip->text = 0;
+  ip->next = itable.inodes;
+  itable.inodes = ip;
   release(&itable.lock);
 
   return ip;
@@ -283,6 +326,28 @@ idup(struct inode *ip)
   return ip;
 }
 
+// Take ip off the inode list.
+// Caller must hold itable.lock.
+static void
+iunlink(struct inode *ip)
+{
+  struct inode **pp;
+
+  for(pp = &itable.inodes; *pp != ip; pp = &(*pp)->next)
+    ;
+  *pp = ip->next;
+}
+
+// Take unreferenced ip off the inode list and free it.
+// Caller must hold itable.lock.
+static void
+ifree(struct inode *ip)
+{
+  iunlink(ip);
+  textfree(ip);
+  slab_free(&itable.cache, ip);
+}
+
 // Lock the given inode.
 // Reads the inode from disk if necessary.
 void
@@ -353,7 +418,19 @@ iput(struct inode *ip)
     acquire(&itable.lock);
   }
 
-  ip->ref--;
+  if(--ip->ref == 0){
+    if(!ip->valid){
+      ifree(ip);
+    } else {
+      // most recently used; keep at most NINODE
+      // unreferenced inodes cached.
+      iunlink(ip);
+      ip->next = itable.inodes;
+      itable.inodes = ip;
+      if(itable.nunused++ >= NINODE)
+        ievict();
+    }
+  }
   release(&itable.lock);
 }
 
@@ -434,6 +511,7 @@ itrunc(struct inode *ip)
 
   ip->size = 0;
   iupdate(ip);
+  textfree(ip);
 }
 
 // Copy stat information from inode.
@@ -493,6 +571,7 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
     return -1;
   if(off + n > MAXFILE*BSIZE)
     return -1;
+  textfree(ip);
 
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
@@ -524,12 +603,13 @@ namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
-// Look for a directory entry in a directory.
+// Return the inode number of the entry for name in
+// directory dp, or 0 if there is none.
 // If found, set *poff to byte offset of entry.
-struct inode*
-dirlookup(struct inode *dp, char *name, uint *poff)
+static uint
+dirfind(struct inode *dp, char *name, uint *poff)
 {
-  uint off, inum;
+  uint off;
   struct dirent de;
 
   if(dp->type != T_DIR)
@@ -544,27 +624,36 @@ dirlookup(struct inode *dp, char *name, uint *poff)
       // entry matches path element
       if(poff)
         *poff = off;
-      inum = de.inum;
-      return iget(dp->dev, inum);
+      return de.inum;
     }
   }
 
   return 0;
 }
 
+// Look for a directory entry in a directory.
+// If found, set *poff to byte offset of entry.
+// Returns 0 if not found, or if out of memory.
+struct inode*
+dirlookup(struct inode *dp, char *name, uint *poff)
+{
+  uint inum;
+
+  if((inum = dirfind(dp, name, poff)) == 0)
+    return 0;
+  return iget(dp->dev, inum);
+}
+
 // Write a new directory entry (name, inum) into the directory dp.
 int
 dirlink(struct inode *dp, char *name, uint inum)
 {
   int off;
   struct dirent de;
-  struct inode *ip;
 
   // Check that name is not present.
-  if((ip = dirlookup(dp, name, 0)) != 0){
-    iput(ip);
+  if(dirfind(dp, name, 0) != 0)
     return -1;
-  }
 
   // Look for an empty dirent.
   for(off = 0; off < dp->size; off += sizeof(de)){
@@ -630,9 +719,10 @@ namex(char *path, int nameiparent, char *name)
 {
   struct inode *ip, *next;
 
-  if(*path == '/')
-    ip = iget(ROOTDEV, ROOTINO);
-  else
+  if(*path == '/'){
+    if((ip = iget(ROOTDEV, ROOTINO)) == 0)
+      return 0;
+  } else
     ip = idup(myproc()->cwd);
 
   while((path = skipelem(path, name)) != 0){
@@ -0,0 +1,22 @@
+// A span of kernel memory.  copyinv()/copyoutv() and
+// either_copyinv()/either_copyoutv() move a list of spans
+// to or from one contiguous range of user memory.
+struct iovec {
+  void *base;
+  uint64 len;
+};
+
+// Describe the m bytes starting at position pos of the ring
+// buffer buf, of size bytes, as one span or, if they wrap,
+// two.  Returns the number of spans.
+static inline int
+ringiov(char *buf, uint size, uint pos, uint m, struct iovec *iov)
+{
+  uint off = pos % size;
+
+  iov[0].base = buf + off;
+  iov[0].len = m < size - off ? m : size - off;
+  iov[1].base = buf;
+  iov[1].len = m - iov[0].len;
+  return iov[1].len ? 2 : 1;
+}
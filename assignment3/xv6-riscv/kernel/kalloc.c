@@ -1,6 +1,27 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
-// and pipe buffers. Allocates whole 4096-byte pages.
+// and pipe buffers.
+//
+// The global pool is a binary buddy allocator over the pages
+// from end to PHYSTOP: kalloc_order(k) returns 2^k physically
+// contiguous pages, aligned to their size, and kfree_order()
+// merges a freed block with its buddy whenever the buddy is
+// free too.
+//
+// Single pages are by far the common case, so each CPU keeps
+// a small cache of free pages and most kalloc()s and kfree()s
+// touch only that CPU's list.  Caches refill from and drain to
+// the buddy pool a batch at a time; a CPU that finds the pool
+// empty steals half of another CPU's cache.
+//
+// Idle CPUs zero free pages ahead of time into a small pool,
+// which kalloc_zeroed() draws on for page tables and user
+// memory.
+//
+// Pages handed out by kalloc() carry a reference count, so
+// copy-on-write fork can share a page between processes:
+// krefinc() adds a reference and kfree() drops one, freeing
+// the page when the last goes.
 
 #include "types.h"
 #include "param.h"
@@ -9,6 +30,19 @@
 #include "riscv.h"
 #include "defs.h"
 
+#define KCACHE_BATCH  32  // pages moved per refill or drain
+#define KCACHE_MAX    64  // drain when a cache grows past this
+#define KZERO_MAX     64  // pages kept in the pre-zeroed pool
+
+#define NPAGES  ((PHYSTOP - KERNBASE) / PGSIZE)
+#define PA2IDX(pa)  (((uint64)(pa) - KERNBASE) / PGSIZE)
+#define IDX2PA(i)   (KERNBASE + (uint64)(i) * PGSIZE)
+
+// Fill pages with junk on kalloc() and kfree(), to catch
+// uninitialised use and dangling references.  Defaults to
+// KALLOC_JUNK; can be flipped at run time from the debugger.
+int kjunk = KALLOC_JUNK;
+
 void freerange(void *pa_start, void *pa_end);
 
 extern char end[]; // first address after kernel.
@@ -16,27 +50,295 @@ extern char end[]; // first address after kernel.
 
 struct run {
   struct run *next;
+  struct run *prev;       // buddy free lists only
+};
+
+// What the allocator knows about each physical page.
+// Only the first page of a free block is marked.
+struct page {
+  char free;              // first page of a free block?
+  char order;             // if so, the block's order
+  int ref;                // references to a kalloc()'d page
 };
 
+static struct page pages[NPAGES];
+
 struct {
   struct spinlock lock;
-  struct run *freelist;
+  struct run *freelist[KMAXORDER+1]; // free blocks of each order
+  int nblocks[KMAXORDER+1];          // length of each list
+  int nfree;                         // free pages in all lists
+  int npages;                        // pages given to the allocator
 } kmem;
 
+// Per-CPU page cache.  The lock is only contended
+// when another CPU steals from this one.  Each CPU's
+// cache has cache lines of its own.
+struct kcache {
+  struct spinlock lock;
+  struct run *freelist;
+  int nfree;              // pages in freelist
+  uint64 nalloc;          // kalloc()s on this CPU
+  uint64 nkfree;          // kfree()s on this CPU
+  uint64 nrefill;         // batches taken from kmem
+  uint64 ndrain;          // batches given back to kmem
+  uint64 nsteal;          // times this CPU stole from another
+} __attribute__((aligned(CACHELINE))) kcache[NCPU];
+
+// Pages zeroed in idle time by kzeroidle().
+struct {
+  struct spinlock lock;
+  struct run *freelist;
+  int nfree;
+  uint64 nhit;            // kalloc_zeroed()s served from the pool
+  uint64 nmiss;           // kalloc_zeroed()s that zeroed a page
+} kzero;
+
 void
 kinit()
 {
-  initlock(&kmem.lock, "kmem");
+  initticketlock(&kmem.lock, "kmem");
+  for(struct kcache *c = kcache; c < &kcache[NCPU]; c++)
+    initlock(&c->lock, "kcache");
+  initlock(&kzero.lock, "kzero");
   freerange(end, (void*)PHYSTOP);
 }
 
+// Put the pages in freerange straight into the buddy
+// pool, so boot doesn't count as kfree()s.
 void
 freerange(void *pa_start, void *pa_end)
 {
   char *p;
+
   p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
-    kfree(p);
+  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE){
+    kfree_order(p, 0);
+    kmem.npages++;
+  }
+}
+
+static void
+buddy_push(uint64 i, int k)
+{
+  struct run *r = (struct run*)IDX2PA(i);
+
+  r->prev = 0;
+  r->next = kmem.freelist[k];
+  if(r->next)
+    r->next->prev = r;
+  kmem.freelist[k] = r;
+  kmem.nblocks[k]++;
+  pages[i].free = 1;
+  pages[i].order = k;
+}
+
+static void
+buddy_remove(uint64 i, int k)
+{
+  struct run *r = (struct run*)IDX2PA(i);
+
+  if(r->prev)
+    r->prev->next = r->next;
+  else
+    kmem.freelist[k] = r->next;
+  if(r->next)
+    r->next->prev = r->prev;
+  kmem.nblocks[k]--;
+  pages[i].free = 0;
+}
+
+// Take a block of order k from the buddy lists, splitting
+// a bigger one if need be.  Caller must hold kmem.lock.
+static void*
+buddy_alloc(int k)
+{
+  struct run *r;
+  uint64 i;
+  int j;
+
+  for(j = k; j <= KMAXORDER && kmem.freelist[j] == 0; j++)
+    ;
+  if(j > KMAXORDER)
+    return 0;
+  r = kmem.freelist[j];
+  i = PA2IDX(r);
+  buddy_remove(i, j);
+  // give back the upper halves.
+  while(j > k){
+    j--;
+    buddy_push(i + (1L << j), j);
+  }
+  kmem.nfree -= 1 << k;
+  return (void*)r;
+}
+
+// Return a block of order k to the buddy lists, merging
+// it with free buddies.  Caller must hold kmem.lock.
+static void
+buddy_free(void *pa, int k)
+{
+  uint64 i, b;
+
+  i = PA2IDX(pa);
+  kmem.nfree += 1 << k;
+  while(k < KMAXORDER){
+    b = i ^ (1L << k);
+    if(b >= NPAGES || !pages[b].free || pages[b].order != k)
+      break;
+    buddy_remove(b, k);
+    if(b < i)
+      i = b;
+    k++;
+  }
+  buddy_push(i, k);
+}
+
+// Allocate 2^order physically contiguous pages, aligned
+// to their total size.  Returns 0 if no such block is free.
+void*
+kalloc_order(int order)
+{
+  void *pa;
+
+  if(order < 0 || order > KMAXORDER)
+    return 0;
+  acquire(&kmem.lock);
+  pa = buddy_alloc(order);
+  release(&kmem.lock);
+  if(pa == 0 && order > 0){
+    // pages sitting in the per-CPU caches can't merge.
+    kdrain();
+    acquire(&kmem.lock);
+    pa = buddy_alloc(order);
+    release(&kmem.lock);
+  }
+  if(pa){
+    pages[PA2IDX(pa)].ref = 1;
+    if(kjunk)
+      memset(pa, 5, PGSIZE << order);
+  }
+  return pa;
+}
+
+// Free a block from kalloc_order(order).
+void
+kfree_order(void *pa, int order)
+{
+  if(order < 0 || order > KMAXORDER)
+    panic("kfree_order: order");
+  if(((uint64)pa % (PGSIZE << order)) != 0 || (char*)pa < end ||
+     (uint64)pa + (PGSIZE << order) > PHYSTOP)
+    panic("kfree_order");
+  if(pages[PA2IDX(pa)].free)
+    panic("kfree_order: double free");
+  pages[PA2IDX(pa)].ref = 0;
+
+  if(kjunk)
+    memset(pa, 1, PGSIZE << order);
+
+  acquire(&kmem.lock);
+  buddy_free(pa, order);
+  release(&kmem.lock);
+}
+
+// Detach up to n pages from the front of *list.
+// Returns them as a list of *got pages.
+static struct run*
+takerun(struct run **list, int n, int *got)
+{
+  struct run *first, *r;
+  int i;
+
+  first = *list;
+  if(first == 0 || n <= 0){
+    *got = 0;
+    return 0;
+  }
+  r = first;
+  for(i = 1; i < n && r->next; i++)
+    r = r->next;
+  *list = r->next;
+  r->next = 0;
+  *got = i;
+  return first;
+}
+
+// Give a list of cached pages back to the buddy pool.
+static void
+kputrun(struct run *r)
+{
+  struct run *next;
+
+  acquire(&kmem.lock);
+  for(; r; r = next){
+    next = r->next;
+    buddy_free(r, 0);
+  }
+  release(&kmem.lock);
+}
+
+// Empty every CPU's cache and the pre-zeroed pool into the
+// buddy pool, so the pages can merge into bigger blocks.
+void
+kdrain(void)
+{
+  struct kcache *c;
+  struct run *r, *p;
+  int n;
+
+  for(c = kcache; c < &kcache[NCPU]; c++){
+    acquire(&c->lock);
+    r = takerun(&c->freelist, c->nfree, &n);
+    c->nfree -= n;
+    release(&c->lock);
+    kputrun(r);
+  }
+
+  acquire(&kzero.lock);
+  r = takerun(&kzero.freelist, kzero.nfree, &n);
+  kzero.nfree -= n;
+  release(&kzero.lock);
+  // pooled pages still hold kzeroidle()'s kalloc() reference.
+  for(p = r; p; p = p->next)
+    pages[PA2IDX(p)].ref = 0;
+  kputrun(r);
+}
+
+// Find free pages for CPU id's empty cache: a batch from the
+// buddy pool, or else half of some other CPU's cache.
+// Returns a list of *got pages.
+static struct run*
+kgrab(int id, int *got)
+{
+  struct kcache *c;
+  struct run *r = 0, *p;
+  int n;
+
+  *got = 0;
+  acquire(&kmem.lock);
+  while(*got < KCACHE_BATCH && (p = buddy_alloc(0)) != 0){
+    p->next = r;
+    r = p;
+    (*got)++;
+  }
+  release(&kmem.lock);
+  if(r)
+    return r;
+
+  for(int i = 1; i < NCPU; i++){
+    c = &kcache[(id + i) % NCPU];
+    acquire(&c->lock);
+    n = (c->nfree + 1) / 2;
+    r = takerun(&c->freelist, n, got);
+    c->nfree -= *got;
+    release(&c->lock);
+    if(r){
+      kcache[id].nsteal++;
+      return r;
+    }
+  }
+  return 0;
 }
 
 // Free the page of physical memory pointed at by v,
@@ -46,20 +348,61 @@ freerange(void *pa_start, void *pa_end)
 void
 kfree(void *pa)
 {
-  struct run *r;
+  struct kcache *c;
+  struct run *r, *drain = 0;
+  int n = 0;
 
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
+  // Still shared (copy-on-write)?
+  n = __sync_sub_and_fetch(&pages[PA2IDX(pa)].ref, 1);
+  if(n > 0)
+    return;
+  if(n < 0)
+    panic("kfree: ref");
+
   // Fill with junk to catch dangling refs.
-  memset(pa, 1, PGSIZE);
+  if(kjunk)
+    memset(pa, 1, PGSIZE);
 
   r = (struct run*)pa;
 
-  acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  release(&kmem.lock);
+  push_off();
+  c = &kcache[cpuid()];
+  acquire(&c->lock);
+  r->next = c->freelist;
+  c->freelist = r;
+  c->nfree++;
+  c->nkfree++;
+  if(c->nfree > KCACHE_MAX){
+    drain = takerun(&c->freelist, KCACHE_BATCH, &n);
+    c->nfree -= n;
+    c->ndrain++;
+  }
+  release(&c->lock);
+
+  if(drain)
+    kputrun(drain);
+  pop_off();
+}
+
+// Take a page from the zeroed pool, or return 0.
+static struct run*
+kzeroget(void)
+{
+  struct run *r;
+
+  acquire(&kzero.lock);
+  r = kzero.freelist;
+  if(r){
+    kzero.freelist = r->next;
+    kzero.nfree--;
+  }
+  release(&kzero.lock);
+  if(r)
+    r->next = 0; // the link was the only non-zero word.
+  return r;
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -68,15 +411,155 @@ kfree(void *pa)
 void *
 kalloc(void)
 {
-  struct run *r;
+  struct kcache *c;
+  struct run *r, *more, *last;
+  int id, n;
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-  release(&kmem.lock);
+  push_off();
+  id = cpuid();
+  c = &kcache[id];
+  acquire(&c->lock);
+  if(c->freelist == 0){
+    // don't hold our lock while taking others'.
+    release(&c->lock);
+    more = kgrab(id, &n);
+    acquire(&c->lock);
+    if(more){
+      for(last = more; last->next; last = last->next)
+        ;
+      last->next = c->freelist;
+      c->freelist = more;
+      c->nfree += n;
+      c->nrefill++;
+    }
+  }
+  r = c->freelist;
+  if(r){
+    c->freelist = r->next;
+    c->nfree--;
+    c->nalloc++;
+  }
+  release(&c->lock);
+  pop_off();
 
-  if(r)
-    memset((char*)r, 5, PGSIZE); // fill with junk
+  if(r == 0)
+    r = kzeroget(); // last resort
+  if(r){
+    pages[PA2IDX(r)].ref = 1;
+    if(kjunk)
+      memset((char*)r, 5, PGSIZE); // fill with junk
+  }
   return (void*)r;
 }
+
+// Add a reference to page pa, from kalloc().
+void
+krefinc(void *pa)
+{
+  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
+    panic("krefinc");
+  if(__sync_fetch_and_add(&pages[PA2IDX(pa)].ref, 1) < 1)
+    panic("krefinc: free page");
+}
+
+// Number of references to page pa.
+int
+krefcount(void *pa)
+{
+  return pages[PA2IDX(pa)].ref;
+}
+
+// Allocate one zero-filled page, from the pre-zeroed
+// pool if possible.  Returns 0 if out of memory.
+void *
+kalloc_zeroed(void)
+{
+  struct run *r;
+
+  if((r = kzeroget()) != 0){
+    __sync_fetch_and_add(&kzero.nhit, 1);
+    pages[PA2IDX(r)].ref = 1;
+    return (void*)r;
+  }
+  __sync_fetch_and_add(&kzero.nmiss, 1);
+  if((r = kalloc()) != 0)
+    memset((char*)r, 0, PGSIZE);
+  return (void*)r;
+}
+
+// Called by an idle CPU's scheduler loop: zero one
+// free page into the pool if it is below KZERO_MAX.
+void
+kzeroidle(void)
+{
+  struct run *r;
+
+  if(kzero.nfree >= KZERO_MAX)
+    return;
+  if((r = kalloc()) == 0)
+    return;
+  memset((char*)r, 0, PGSIZE);
+  acquire(&kzero.lock);
+  r->next = kzero.freelist;
+  kzero.freelist = r;
+  kzero.nfree++;
+  release(&kzero.lock);
+}
+
+// Number of free pages, for the page reclaimer.  Read
+// without locks, so only approximate.
+int
+kfreecount(void)
+{
+  struct kcache *c;
+  int n;
+
+  n = kmem.nfree + kzero.nfree;
+  for(c = kcache; c < &kcache[NCPU]; c++)
+    n += c->nfree;
+  return n;
+}
+
+// Number of pages the allocator manages, free or not.
+int
+ktotalcount(void)
+{
+  return kmem.npages;
+}
+
+// Print the allocator's counters to the console.
+void
+kallocdump(void)
+{
+  struct kcache *c;
+  int k, total, largest = -1, big = 0;
+
+  printf("\nbuddy: %d free pages; free blocks by order:", kmem.nfree);
+  for(k = 0; k <= KMAXORDER; k++){
+    printf(" %d", kmem.nblocks[k]);
+    if(kmem.nblocks[k]){
+      largest = k;
+      if(k >= KFRAGORDER)
+        big += kmem.nblocks[k] << k;
+    }
+  }
+  printf("\n");
+  // fragmentation: how much free memory is in pieces too
+  // small for an order-KFRAGORDER allocation.
+  printf("largest free order %d, %d%% of free pages in blocks of order < %d\n",
+         largest, kmem.nfree ? (kmem.nfree - big) * 100 / kmem.nfree : 0,
+         KFRAGORDER);
+
+  total = kmem.nfree + kzero.nfree;
+  printf("kzero: %d zeroed pages, %d hits %d misses\n",
+         kzero.nfree, (int)kzero.nhit, (int)kzero.nmiss);
+  for(c = kcache; c < &kcache[NCPU]; c++){
+    total += c->nfree;
+    if(c->nalloc == 0 && c->nkfree == 0 && c->nfree == 0)
+      continue;
+    printf("cpu%d: cached %d alloc %d free %d refill %d drain %d steal %d\n",
+           (int)(c - kcache), c->nfree, (int)c->nalloc, (int)c->nkfree,
+           (int)c->nrefill, (int)c->ndrain, (int)c->nsteal);
+  }
+  printf("total free pages %d of %d\n", total, kmem.npages);
+}
@@ -0,0 +1,17 @@
+// Lock contention counters, kept per lock name, so that
+// e.g. all the "proc" locks are counted together.
+// The wait and hold times cost two time CSR reads per
+// acquire, so are only kept if LOCKSTAT is set in param.h.
+// The lockstat() system call copies them to user space.
+#define LOCK_SPIN  0
+#define LOCK_SLEEP 1
+
+struct lockstat {
+  char name[16];     // Lock name
+  int type;          // LOCK_SPIN or LOCK_SLEEP
+  uint64 nacquire;   // Number of acquisitions
+  uint64 ncontended; // Acquisitions that had to wait
+  uint64 nspin;      // Spin-loop iterations (spin locks)
+  uint64 waitcycles; // Total time spent waiting, in time CSR cycles (LOCKSTAT)
+  uint64 maxhold;    // Longest hold, in time CSR cycles (LOCKSTAT)
+};
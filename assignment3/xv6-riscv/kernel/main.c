@@ -29,8 +29,13 @@ main()
     binit();         // buffer cache
     iinit();         // inode table
     fileinit();      // file table
+    textinit();      // shared program text cache
+    pipeinit();      // pipe cache
+    bqueueinit();    // producer/consumer queues
+    shminit();       // shared memory segments
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
+    kthread("kswapd", swapd); // page reclaimer
     __sync_synchronize();
     started = 1;
   } else {
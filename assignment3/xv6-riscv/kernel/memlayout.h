@@ -53,7 +53,9 @@
 
 // map kernel stacks beneath the trampoline,
 // each surrounded by invalid guard pages.
-#define KSTACK(p) (TRAMPOLINE - ((p)+1)* 2*PGSIZE)
+// allocproc() maps a stack, and freeproc() unmaps it.
+#define KSTACKSIZE (KSTACKPAGES*PGSIZE)
+#define KSTACK(p) (TRAMPOLINE - ((p)+1)*(KSTACKSIZE+PGSIZE))
 
 // User memory layout.
 // Address zero first:
@@ -62,6 +64,17 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   MMAPBASE (mmap() regions)
+//   SHMBASE (shared memory segments)
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+
+// shared memory segments are attached below the trapframe,
+// each process slot getting a window of SHM_MAXPAGES pages.
+#define SHMBASE (TRAPFRAME - NSHMPROC*SHM_MAXPAGES*PGSIZE)
+#define SHMVA(slot) (SHMBASE + (slot)*SHM_MAXPAGES*PGSIZE)
+
+// mmap() places regions in the 4 GB below SHMBASE.
+// the heap may not grow past MMAPBASE.
+#define MMAPBASE (SHMBASE - (1L << 32))
@@ -0,0 +1,297 @@
+// Memory-mapped files and anonymous memory.
+//
+// Each process has a small table of mappings (struct vma)
+// placed between MMAPBASE and SHMBASE.  mmap() only records
+// the mapping; mmapfault() fills each page the first time it
+// is touched, from the file through the buffer cache or with
+// zeros for MAP_ANONYMOUS.  Pages of a MAP_SHARED file mapping
+// are written back to the file, through the log, by munmap()
+// and when the process exits or execs.  fork() gives the child
+// the same mappings: MAP_SHARED pages are shared outright,
+// MAP_PRIVATE pages are copy-on-write.  A page first touched
+// after the fork would be filled separately in each process,
+// so fork() fills every page of the MAP_SHARED mappings first.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "fs.h"
+#include "file.h"
+#include "fcntl.h"
+#include "defs.h"
+
+// Return p's mapping containing va, or 0.
+static struct vma*
+findvma(struct proc *p, uint64 va)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->used && va >= v->start && va < v->start + v->len)
+      return v;
+  return 0;
+}
+
+// Find len free bytes of address space for a new mapping.
+// Returns the address, or 0.
+static uint64
+findspace(struct proc *p, uint64 len)
+{
+  struct vma *v;
+  uint64 a = MMAPBASE;
+
+again:
+  if(a + len > SHMBASE || a + len < a)
+    return 0;
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->used && a < v->start + v->len && v->start < a + len){
+      a = v->start + v->len;
+      goto again;
+    }
+  }
+  return a;
+}
+
+// Map len bytes of f starting at offset off, or anonymous
+// memory if flags has MAP_ANONYMOUS, into the current
+// process.  Returns the address, or -1.
+uint64
+mmap(uint64 len, int prot, int flags, struct file *f, uint off)
+{
+  struct proc *p = myproc();
+  struct vma *v, *nv = 0;
+  int share = flags & (MAP_SHARED|MAP_PRIVATE);
+  uint64 va;
+
+  if(len == 0 || (off % PGSIZE) != 0)
+    return -1;
+  if(share != MAP_SHARED && share != MAP_PRIVATE)
+    return -1;
+  if((prot & ~(PROT_READ|PROT_WRITE)) != 0)
+    return -1;
+  if((flags & MAP_ANONYMOUS) == 0){
+    if(f == 0 || f->type != FD_INODE)
+      return -1;
+    if(!f->readable)
+      return -1;
+    if(share == MAP_SHARED && (prot & PROT_WRITE) && !f->writable)
+      return -1;
+  }
+
+  len = PGROUNDUP(len);
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(!v->used){
+      nv = v;
+      break;
+    }
+  }
+  if(nv == 0 || (va = findspace(p, len)) == 0)
+    return -1;
+
+  nv->used = 1;
+  nv->start = va;
+  nv->len = len;
+  nv->prot = prot;
+  nv->flags = flags;
+  nv->off = off;
+  nv->f = (flags & MAP_ANONYMOUS) ? 0 : filedup(f);
+  return va;
+}
+
+// Fill in page va of one of p's mappings.
+// Returns 0, or -1 if the access is not allowed or
+// memory is short.
+int
+mmapfault(struct proc *p, uint64 va, int write)
+{
+  struct vma *v;
+  uint64 off;
+  char *mem;
+  int perm;
+
+  va = PGROUNDDOWN(va);
+  if((v = findvma(p, va)) == 0)
+    return -1;
+  if(write && (v->prot & PROT_WRITE) == 0)
+    return -1;
+
+  perm = PTE_U | PTE_R;
+  if(v->prot & PROT_WRITE)
+    perm |= PTE_W;
+
+  if(v->f == 0){
+    if((mem = kalloc_zeroed()) == 0)
+      return -1;
+  } else {
+    if((mem = kalloc()) == 0)
+      return -1;
+    memset(mem, 0, PGSIZE);
+    off = v->off + (va - v->start);
+    ilock(v->f->ip);
+    if(readi(v->f->ip, 0, (uint64)mem, off, PGSIZE) < 0){
+      iunlock(v->f->ip);
+      kfree(mem);
+      return -1;
+    }
+    iunlock(v->f->ip);
+  }
+  if(mappages(p->pagetable, va, PGSIZE, (uint64)mem, perm) != 0){
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
+// Write the dirty pages of v between va and va+len back
+// to its file, if it is a writable MAP_SHARED file mapping.
+// Never extends the file, or writes a running program.
+static void
+writeback(struct proc *p, struct vma *v, uint64 va, uint64 len)
+{
+  struct inode *ip;
+  pte_t *pte;
+  uint64 a, pa;
+  uint off, n, n1, max, i;
+
+  if(v->f == 0 || (v->flags & MAP_SHARED) == 0 || (v->prot & PROT_WRITE) == 0)
+    return;
+  ip = v->f->ip;
+  // as in filewrite(), keep each transaction small.
+  max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+  for(a = va; a < va + len; a += PGSIZE){
+    pte = walk(p->pagetable, a, 0);
+    if(pte == 0 || (*pte & (PTE_V|PTE_D)) != (PTE_V|PTE_D))
+      continue;
+    pa = PTE2PA(*pte);
+    *pte &= ~PTE_D;
+    p->tlbflush = 1;
+    off = v->off + (a - v->start);
+    for(i = 0; i < PGSIZE; i += n1){
+      begin_op();
+      ilock(ip);
+      n1 = 0;
+      if(off + i < ip->size && ip->nexec == 0){
+        n = ip->size - (off + i);
+        n1 = PGSIZE - i;
+        if(n1 > n)
+          n1 = n;
+        if(n1 > max)
+          n1 = max;
+        if(writei(ip, 0, pa + i, off + i, n1) != n1)
+          n1 = 0;
+      }
+      iunlock(ip);
+      end_op();
+      if(n1 == 0)
+        break;
+    }
+  }
+}
+
+// Remove the mapping of [va, va+len), which must be at one
+// end (or all) of a single mapping.  Returns 0, or -1.
+int
+munmap(uint64 va, uint64 len)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  struct file *f;
+
+  if((va % PGSIZE) != 0 || len == 0)
+    return -1;
+  len = PGROUNDUP(len);
+  if((v = findvma(p, va)) == 0 || va + len > v->start + v->len || va + len < va)
+    return -1;
+  if(va != v->start && va + len != v->start + v->len)
+    return -1; // would split the mapping
+
+  writeback(p, v, va, len);
+  uvmunmap(p->pagetable, va, len / PGSIZE, 1);
+  if(va == v->start){
+    v->start += len;
+    v->off += len;
+  }
+  v->len -= len;
+  if(v->len == 0){
+    f = v->f;
+    v->used = 0;
+    v->f = 0;
+    if(f)
+      fileclose(f);
+  }
+  return 0;
+}
+
+// Fill in every page of p's MAP_SHARED mappings, so that a
+// child fork()ed next shares all of them.  Called before
+// allocproc(), since it may sleep.  Returns 0, or -1 if
+// memory is short.
+int
+mmapshare(struct proc *p)
+{
+  struct vma *v;
+  uint64 a;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(!v->used || (v->flags & MAP_SHARED) == 0)
+      continue;
+    for(a = v->start; a < v->start + v->len; a += PGSIZE)
+      if(walkaddr(p->pagetable, a) == 0 && mmapfault(p, a, 0) < 0)
+        return -1;
+  }
+  return 0;
+}
+
+// Give child np the same mappings as p.
+// Returns 0, or -1 with nothing mapped into np.
+// Called with np->lock held, so must not sleep.
+int
+mmapfork(struct proc *p, struct proc *np)
+{
+  struct vma *v;
+  int i;
+
+  for(i = 0; i < NVMA; i++){
+    v = &p->vma[i];
+    if(!v->used)
+      continue;
+    if(uvmcopyrange(p->pagetable, np->pagetable, v->start,
+                    v->start + v->len, v->flags & MAP_SHARED) < 0){
+      while(--i >= 0){
+        v = &p->vma[i];
+        if(v->used)
+          uvmunmap(np->pagetable, v->start, v->len / PGSIZE, 1);
+      }
+      return -1;
+    }
+  }
+  for(i = 0; i < NVMA; i++){
+    np->vma[i] = p->vma[i];
+    if(np->vma[i].used && np->vma[i].f)
+      filedup(np->vma[i].f);
+  }
+  return 0;
+}
+
+// Write back and remove all of p's mappings.
+// Called from exec() and exit(); may sleep.
+void
+mmaprelease(struct proc *p)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(!v->used)
+      continue;
+    writeback(p, v, v->start, v->len);
+    uvmunmap(p->pagetable, v->start, v->len / PGSIZE, 1);
+    v->used = 0;
+    if(v->f)
+      fileclose(v->f);
+    v->f = 0;
+  }
+}
@@ -1,16 +1,27 @@
-#define NPROC        64  // maximum number of processes
+#define NPROC      4096  // maximum number of processes
 #define NCPU          8  // maximum number of CPUs
+#define KSTACKPAGES   2  // pages in each process's kernel stack
 #define NOFILE       16  // open files per process
-#define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NINODE       50  // unreferenced i-nodes kept cached
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
+#define NEXECSEG     4   // max loadable ELF segments per program
+#define NVMA         16  // mmap() regions per process
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       2000  // size of file system in blocks
+#define SWAPBLOCKS   65536 // size of swap area after the file system
 #define MAXPATH      128   // maximum file path name
+#define NSHM         16    // maximum number of shared memory segments
+#define NSHMPROC     4     // shared memory segments attached per process
+#define SHM_MAXPAGES 16    // maximum pages in a shared memory segment
+#define NLOCKSTAT    64    // distinct lock names with contention counters
+#define LOCKSTAT     0     // also time lock waits and holds? (1 to enable)
+#define KALLOC_JUNK  0     // junk-fill pages in kalloc/kfree? (debugging)
+#define KMAXORDER    10    // largest kalloc_order() block is 2^KMAXORDER pages
+#define KFRAGORDER   4     // block order that fragmentation is reported against
 //#define TIMER_INTERVAL 1000000
 #define TIMER_INTERVAL 100000
 #define SCHED_NPREEMPT_FCFS 0
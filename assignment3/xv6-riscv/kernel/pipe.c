@@ -7,6 +7,8 @@
 #include "fs.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "slab.h"
+#include "iovec.h"
 
 #define PIPESIZE 512
 
@@ -19,6 +21,20 @@ struct pipe {
   int writeopen;  // write fd is still open
 };
 
+static struct slab_cache pipecache;
+
+static void
+pipector(void *obj)
+{
+  initlock(&((struct pipe*)obj)->lock, "pipe");
+}
+
+void
+pipeinit(void)
+{
+  slab_cache_init(&pipecache, "pipe", sizeof(struct pipe), pipector);
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -28,13 +44,12 @@ pipealloc(struct file **f0, struct file **f1)
   *f0 = *f1 = 0;
   if((*f0 = filealloc()) == 0 || (*f1 = filealloc()) == 0)
     goto bad;
-  if((pi = (struct pipe*)kalloc()) == 0)
+  if((pi = (struct pipe*)slab_alloc(&pipecache)) == 0)
     goto bad;
   pi->readopen = 1;
   pi->writeopen = 1;
   pi->nwrite = 0;
   pi->nread = 0;
-  initlock(&pi->lock, "pipe");
   (*f0)->type = FD_PIPE;
   (*f0)->readable = 1;
   (*f0)->writable = 0;
@@ -47,7 +62,7 @@ pipealloc(struct file **f0, struct file **f1)
 
  bad:
   if(pi)
-    kfree((char*)pi);
+    slab_free(&pipecache, pi);
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -68,16 +83,19 @@ pipeclose(struct pipe *pi, int writable)
   }
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
-    kfree((char*)pi);
+    slab_free(&pipecache, pi);
   } else
     release(&pi->lock);
 }
 
+// Copy from user memory straight into the ring, as many
+// bytes at a time as there is room for.
 int
 pipewrite(struct pipe *pi, uint64 addr, int n)
 {
-  int i = 0;
+  int i = 0, m, niov;
   struct proc *pr = myproc();
+  struct iovec iov[2];
 
   acquire(&pi->lock);
   while(i < n){
@@ -89,11 +107,14 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
       wakeup(&pi->nread);
       sleep(&pi->nwrite, &pi->lock);
     } else {
-      char ch;
-      if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
+      m = n - i;
+      if(m > pi->nread + PIPESIZE - pi->nwrite)
+        m = pi->nread + PIPESIZE - pi->nwrite;
+      niov = ringiov(pi->data, PIPESIZE, pi->nwrite, m, iov);
+      if(copyinv(pr->pagetable, iov, niov, addr + i) == -1)
         break;
-      pi->data[pi->nwrite++ % PIPESIZE] = ch;
-      i++;
+      pi->nwrite += m;
+      i += m;
     }
   }
   wakeup(&pi->nread);
@@ -105,9 +126,9 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
 int
 piperead(struct pipe *pi, uint64 addr, int n)
 {
-  int i;
+  int i, niov;
   struct proc *pr = myproc();
-  char ch;
+  struct iovec iov[2];
 
   acquire(&pi->lock);
   while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
@@ -117,13 +138,14 @@ piperead(struct pipe *pi, uint64 addr, int n)
     }
     sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(pi->nread == pi->nwrite)
-      break;
-    ch = pi->data[pi->nread++ % PIPESIZE];
-    if(copyout(pr->pagetable, addr + i, &ch, 1) == -1)
-      break;
-  }
+  i = n > 0 ? n : 0;  //DOC: piperead-copy
+  if(i > pi->nwrite - pi->nread)
+    i = pi->nwrite - pi->nread;
+  niov = ringiov(pi->data, PIPESIZE, pi->nread, i, iov);
+  if(copyoutv(pr->pagetable, addr, iov, niov) == -1)
+    i = -1;
+  else
+    pi->nread += i;
   wakeup(&pi->nwrite);  //DOC: piperead-wakeup
   release(&pi->lock);
   return i;
@@ -26,11 +26,11 @@ static struct {
 static char digits[] = "0123456789abcdef";
 
 static void
-printint(int xx, int base, int sign)
+printint(long xx, int base, int sign)
 {
-  char buf[16];
+  char buf[24];
   int i;
-  uint x;
+  uint64 x;
 
   if(sign && (sign = xx < 0))
     x = -xx;
@@ -59,7 +59,7 @@ printptr(uint64 x)
     consputc(digits[x >> (sizeof(uint64) * 8 - 4)]);
 }
 
-// Print to the console. only understands %d, %x, %p, %s.
+// Print to the console. only understands %d, %l, %x, %p, %s.
 void
 printf(char *fmt, ...)
 {
@@ -87,6 +87,9 @@ printf(char *fmt, ...)
     case 'd':
       printint(va_arg(ap, int), 10, 1);
       break;
+    case 'l':
+      printint(va_arg(ap, uint64), 10, 0);
+      break;
     case 'x':
       printint(va_arg(ap, int), 16, 1);
       break;
@@ -5,22 +5,43 @@
 #include "spinlock.h"
 #include "condvar.h"
 #include "sleeplock.h"
+#include "rwlock.h"
 #include "proc.h"
 #include "defs.h"
 #include "procstat.h"
+#include "iovec.h"
+#include "slab.h"
 
 int sched_policy;
 
 struct cpu cpus[NCPU];
 
-struct proc proc[NPROC];
+// The process table.  struct procs come from a slab cache
+// as they are needed, up to NPROC of them, and are never
+// freed: freeproc() puts one on the free list for the next
+// allocproc().  So a struct proc stays a struct proc, and
+// the scheduler, wakeup() and the swapper can walk the list
+// of all of them without a lock, as they did the old array.
+static struct {
+  struct spinlock lock;    // protects free, tail and additions
+  struct slab_cache cache;
+  struct proc *free;       // UNUSED procs
+  struct proc *tail;       // last on allproc
+} ptable;
+
+struct proc *allproc;      // every struct proc, oldest first
+int nproc;                 // how many
 
 struct proc *initproc;
 
+#define NPIDHASH 256
+
 int nextpid = 1;
-struct spinlock pid_lock;
+struct spinlock pid_lock;  // protects nextpid and pidhash
+static struct proc *pidhash[NPIDHASH];
 
 extern void forkret(void);
+static void kthreadret(void);
 static void freeproc(struct proc *p);
 
 //Stats
@@ -49,36 +70,145 @@ extern char trampoline[]; // trampoline.S
 // parents are not lost. helps obey the
 // memory model when using p->parent.
 // must be acquired before any p->lock.
-struct spinlock wait_lock;
+// held for writing to change p->parent and the lists of
+// children (fork, exit), for reading to look at them (wait,
+// ps, pinfo, getppid).  a parent reaping a zombie takes it
+// off its own list of zombies with only a read hold: nothing
+// else changes a zombie's parent, or the list without writing.
+struct rwspinlock wait_lock;
+
+// How deep p's kernel stack has ever been, in bytes.
+// Stacks start out zeroed, so find the lowest word
+// that isn't.
+static int
+kstackused(struct proc *p)
+{
+  uint64 *w = (uint64*)p->kstack;
+  int i, n = KSTACKSIZE / sizeof(uint64);
+
+  for(i = 0; i < n && w[i] == 0; i++)
+    ;
+  return (n - i) * sizeof(uint64);
+}
 
-// Allocate a page for each process's kernel stack.
-// Map it high in memory, followed by an invalid
-// guard page.
+// initialize the proc table at boot time.
 void
-proc_mapstacks(pagetable_t kpgtbl) {
+procinit(void)
+{
+  initlock(&pid_lock, "nextpid");
+  initrwlock(&wait_lock, "wait_lock");
+  initlock(&ptable.lock, "ptable");
+  slab_cache_init(&ptable.cache, "proc", sizeof(struct proc), 0);
+}
+
+// Add a new struct proc to the table, with its own kernel
+// stack address, high in memory below an invalid guard
+// page.  Returns 0 if the table is full or out of memory.
+// Caller must hold ptable.lock.
+static struct proc*
+procnew(void)
+{
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    char *pa = kalloc();
-    if(pa == 0)
-      panic("kalloc");
-    uint64 va = KSTACK((int) (p - proc));
-    kvmmap(kpgtbl, va, (uint64)pa, PGSIZE, PTE_R | PTE_W);
+  if(nproc == NPROC || (p = slab_alloc(&ptable.cache)) == 0)
+    return 0;
+  memset(p, 0, sizeof(*p));
+  initlock(&p->lock, "proc");
+  p->kstack = KSTACK(nproc);
+  // the stack's page-table pages, so that allocproc()
+  // can map a stack without allocating them.
+  if(kvminitstack(p->kstack, KSTACKPAGES) < 0){
+    slab_free(&ptable.cache, p);
+    return 0;
   }
+
+  // p is complete before walkers of allproc can see it.
+  __sync_synchronize();
+  if(ptable.tail)
+    ptable.tail->next = p;
+  else
+    allproc = p;
+  ptable.tail = p;
+  nproc++;
+  return p;
 }
 
-// initialize the proc table at boot time.
-void
-procinit(void)
+// The process after p in the table, wrapping around to the
+// first; the first if p is 0.  For scans that carry on
+// where the last one stopped.
+struct proc*
+procnext(struct proc *p)
+{
+  if(p == 0 || p->next == 0)
+    return allproc;
+  return p->next;
+}
+
+// Return the process with the given pid, locked, or 0.
+static struct proc*
+findproc(int pid)
 {
   struct proc *p;
 
-  initlock(&pid_lock, "nextpid");
-  initlock(&wait_lock, "wait_lock");
-  for(p = proc; p < &proc[NPROC]; p++) {
-      initlock(&p->lock, "proc");
-      p->kstack = KSTACK((int) (p - proc));
+  acquire(&pid_lock);
+  for(p = pidhash[pid % NPIDHASH]; p; p = p->pidnext)
+    if(p->pid == pid)
+      break;
+  release(&pid_lock);
+  if(p == 0)
+    return 0;
+  // p may have exited since; it is still a struct proc.
+  acquire(&p->lock);
+  if(p->pid != pid || p->state == UNUSED){
+    release(&p->lock);
+    return 0;
   }
+  return p;
+}
+
+// Put p on the list of children or zombies at *head.
+// Caller must hold wait_lock for writing.
+static void
+sibadd(struct proc **head, struct proc *p)
+{
+  p->sibprev = 0;
+  p->sibnext = *head;
+  if(*head)
+    (*head)->sibprev = p;
+  *head = p;
+}
+
+// Take p off the list at *head.
+// Caller must hold wait_lock, for reading if it is the parent.
+static void
+sibdel(struct proc **head, struct proc *p)
+{
+  if(p->sibprev)
+    p->sibprev->sibnext = p->sibnext;
+  else
+    *head = p->sibnext;
+  if(p->sibnext)
+    p->sibnext->sibprev = p->sibprev;
+  p->sibnext = p->sibprev = 0;
+}
+
+// Make p a child of parent.
+// Caller must hold wait_lock for writing.
+static void
+addchild(struct proc *parent, struct proc *p)
+{
+  p->parent = parent;
+  sibadd(&parent->children, p);
+}
+
+// Take zombie p off its parent's list, to be freed.
+// Caller must hold wait_lock; the parent may hold it
+// for reading.
+static void
+delzombie(struct proc *p)
+{
+  sibdel(&p->parent->zombies, p);
+  p->parent = 0;
 }
 
 // Must be called with interrupts disabled,
@@ -110,19 +240,34 @@ myproc(void) {
   return p;
 }
 
-int
-allocpid() {
-  int pid;
-
+// Give p a pid and enter it in pidhash.
+static void
+allocpid(struct proc *p) {
   acquire(&pid_lock);
-  pid = nextpid;
+  p->pid = nextpid;
   nextpid = nextpid + 1;
+  p->pidnext = pidhash[p->pid % NPIDHASH];
+  pidhash[p->pid % NPIDHASH] = p;
   release(&pid_lock);
+}
 
-  return pid;
+static void
+freepid(struct proc *p) {
+  struct proc **pp;
+
+  acquire(&pid_lock);
+  for(pp = &pidhash[p->pid % NPIDHASH]; *pp; pp = &(*pp)->pidnext){
+    if(*pp == p){
+      *pp = p->pidnext;
+      break;
+    }
+  }
+  release(&pid_lock);
+  p->pidnext = 0;
+  p->pid = 0;
 }
 
-// Look in the process table for an UNUSED proc.
+// Take an UNUSED proc from the free list, or make a new one.
 // If found, initialize state required to run in the kernel,
 // and return with p->lock held.
 // If there are no free procs, or a memory allocation fails, return 0.
@@ -132,20 +277,30 @@ allocproc(void)
   struct proc *p;
   uint xticks;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    acquire(&p->lock);
-    if(p->state == UNUSED) {
-      goto found;
-    } else {
-      release(&p->lock);
-    }
-  }
-  return 0;
+  swapthrottle();
 
-found:
-  p->pid = allocpid();
+  acquire(&ptable.lock);
+  if((p = ptable.free) != 0)
+    ptable.free = p->freenext;
+  else
+    p = procnew();
+  release(&ptable.lock);
+  if(p == 0)
+    return 0;
+
+  // p is off the free list, so no other allocproc() can
+  // have it; but scans of allproc may briefly lock it.
+  acquire(&p->lock);
+  p->freenext = 0;
+  allocpid(p);
   p->state = USED;
 
+  if(kvmallocstack(p->kstack, KSTACKPAGES) < 0){
+    freeproc(p);
+    release(&p->lock);
+    return 0;
+  }
+
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
     freeproc(p);
@@ -153,19 +308,20 @@ found:
     return 0;
   }
 
-  // An empty user page table.
+  // An empty user page table, and an address-space ID for it.
   p->pagetable = proc_pagetable(p);
   if(p->pagetable == 0){
     freeproc(p);
     release(&p->lock);
     return 0;
   }
+  asidalloc(p);
 
   // Set up new context to start executing at forkret,
   // which returns to user space.
   memset(&p->context, 0, sizeof(p->context));
   p->context.ra = (uint64)forkret;
-  p->context.sp = p->kstack + PGSIZE;
+  p->context.sp = p->kstack + KSTACKSIZE;
 
   acquire(&tickslock);
   xticks = ticks;
@@ -190,17 +346,29 @@ freeproc(struct proc *p)
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
-  if(p->pagetable)
+  kvmfreestack(p->kstack, KSTACKPAGES);
+  if(p->pagetable){
+    shmrelease(p);
     proc_freepagetable(p->pagetable, p->sz);
+  }
   p->pagetable = 0;
   p->sz = 0;
-  p->pid = 0;
+  p->swaphand = 0;
+  p->pinstart = p->pinend = 0;
+  p->kthread = 0;
+  if(p->pid)
+    freepid(p);
   p->parent = 0;
   p->name[0] = 0;
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
   p->state = UNUSED;
+
+  acquire(&ptable.lock);
+  p->freenext = ptable.free;
+  ptable.free = p;
+  release(&ptable.lock);
 }
 
 // Create a user page table for a given process,
@@ -285,19 +453,23 @@ userinit(void)
 }
 
 // Grow or shrink user memory by n bytes.
+// Growth only reserves the addresses; vmfault()
+// allocates each page when it is first touched.
 // Return 0 on success, -1 on failure.
 int
 growproc(int n)
 {
-  uint sz;
+  uint64 sz;
   struct proc *p = myproc();
 
   sz = p->sz;
   if(n > 0){
-    if((sz = uvmalloc(p->pagetable, sz, sz + n)) == 0) {
+    if(sz + n > MMAPBASE)
       return -1;
-    }
+    sz += n;
   } else if(n < 0){
+    if(-(long)n > sz)
+      return -1;
     sz = uvmdealloc(p->pagetable, sz, sz + n);
   }
   p->sz = sz;
@@ -313,6 +485,10 @@ fork(void)
   struct proc *np;
   struct proc *p = myproc();
 
+  // Every MAP_SHARED page must exist to be shared.
+  if(mmapshare(p) < 0)
+    return -1;
+
   // Allocate process.
   if((np = allocproc()) == 0){
     return -1;
@@ -326,6 +502,20 @@ fork(void)
   }
   np->sz = p->sz;
 
+  // Share the parent's shared memory segments.
+  if(shmfork(p, np) < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+
+  // and its mmap() regions.
+  if(mmapfork(p, np) < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
 
@@ -337,6 +527,7 @@ fork(void)
     if(p->ofile[i])
       np->ofile[i] = filedup(p->ofile[i]);
   np->cwd = idup(p->cwd);
+  execfork(p, np);
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
@@ -344,9 +535,9 @@ fork(void)
 
   release(&np->lock);
 
-  acquire(&wait_lock);
-  np->parent = p;
-  release(&wait_lock);
+  acquirewrite(&wait_lock);
+  addchild(p, np);
+  releasewrite(&wait_lock);
 
   acquire(&np->lock);
   np->state = RUNNABLE;
@@ -362,6 +553,10 @@ forkf(uint64 faddr)
   struct proc *np;
   struct proc *p = myproc();
 
+  // Every MAP_SHARED page must exist to be shared.
+  if(mmapshare(p) < 0)
+    return -1;
+
   // Allocate process.
   if((np = allocproc()) == 0){
     return -1;
@@ -375,6 +570,20 @@ forkf(uint64 faddr)
   }
   np->sz = p->sz;
 
+  // Share the parent's shared memory segments.
+  if(shmfork(p, np) < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+
+  // and its mmap() regions.
+  if(mmapfork(p, np) < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
 
@@ -388,6 +597,7 @@ forkf(uint64 faddr)
     if(p->ofile[i])
       np->ofile[i] = filedup(p->ofile[i]);
   np->cwd = idup(p->cwd);
+  execfork(p, np);
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
@@ -395,9 +605,9 @@ forkf(uint64 faddr)
 
   release(&np->lock);
 
-  acquire(&wait_lock);
-  np->parent = p;
-  release(&wait_lock);
+  acquirewrite(&wait_lock);
+  addchild(p, np);
+  releasewrite(&wait_lock);
 
   acquire(&np->lock);
   np->state = RUNNABLE;
@@ -415,6 +625,10 @@ forkp(int priority)
   struct proc *np;
   struct proc *p = myproc();
 
+  // Every MAP_SHARED page must exist to be shared.
+  if(mmapshare(p) < 0)
+    return -1;
+
   // Allocate process.
   if((np = allocproc()) == 0){
     return -1;
@@ -428,6 +642,20 @@ forkp(int priority)
   }
   np->sz = p->sz;
 
+  // Share the parent's shared memory segments.
+  if(shmfork(p, np) < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+
+  // and its mmap() regions.
+  if(mmapfork(p, np) < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
 
@@ -439,6 +667,7 @@ forkp(int priority)
     if(p->ofile[i])
       np->ofile[i] = filedup(p->ofile[i]);
   np->cwd = idup(p->cwd);
+  execfork(p, np);
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
@@ -455,9 +684,71 @@ forkp(int priority)
   batchsize++;
   batchsize2++;
 
-  acquire(&wait_lock);
-  np->parent = p;
-  release(&wait_lock);
+  acquirewrite(&wait_lock);
+  addchild(p, np);
+  releasewrite(&wait_lock);
+
+  acquire(&np->lock);
+  np->state = RUNNABLE;
+  np->waitstart = np->ctime;
+  release(&np->lock);
+
+  return pid;
+}
+
+// Create a batch process running the program in path, like
+// forkp(priority) followed by exec(path, argv) in the child,
+// but without copying the caller's memory only to discard it.
+// The child shares the caller's open files and directory.
+// Returns the child's pid, or -1.
+int
+spawn(char *path, char **argv, int priority)
+{
+  int i, pid, argc;
+  struct proc *np;
+  struct proc *p = myproc();
+
+  // Allocate process.
+  if((np = allocproc()) == 0){
+    return -1;
+  }
+  // np is USED, so nothing else will touch it;
+  // don't hold its lock while reading the file.
+  release(&np->lock);
+
+  memset(np->trapframe, 0, sizeof(*np->trapframe));
+  if((argc = execproc(np, path, argv)) < 0){
+    acquire(&np->lock);
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  np->trapframe->a0 = argc;
+
+  acquire(&np->lock);
+
+  // increment reference counts on open file descriptors.
+  for(i = 0; i < NOFILE; i++)
+    if(p->ofile[i])
+      np->ofile[i] = filedup(p->ofile[i]);
+  np->cwd = idup(p->cwd);
+
+  pid = np->pid;
+
+  np->base_priority = priority;
+
+  np->is_batchproc = 1;
+  np->nextburst_estimate = 0;
+  np->waittime = 0;
+
+  release(&np->lock);
+
+  batchsize++;
+  batchsize2++;
+
+  acquirewrite(&wait_lock);
+  addchild(p, np);
+  releasewrite(&wait_lock);
 
   acquire(&np->lock);
   np->state = RUNNABLE;
@@ -467,19 +758,27 @@ forkp(int priority)
   return pid;
 }
 
-// Pass p's abandoned children to init.
-// Caller must hold wait_lock.
+// Pass p's abandoned children to init, waking it
+// if any are already zombies.
+// Caller must hold wait_lock for writing.
 void
 reparent(struct proc *p)
 {
   struct proc *pp;
+  int zombies = 0;
 
-  for(pp = proc; pp < &proc[NPROC]; pp++){
-    if(pp->parent == p){
-      pp->parent = initproc;
-      wakeup(initproc);
-    }
+  while((pp = p->children) != 0){
+    sibdel(&p->children, pp);
+    addchild(initproc, pp);
+  }
+  while((pp = p->zombies) != 0){
+    sibdel(&p->zombies, pp);
+    pp->parent = initproc;
+    sibadd(&initproc->zombies, pp);
+    zombies = 1;
   }
+  if(zombies)
+    wakeup(initproc);
 }
 
 // Exit the current process.  Does not return.
@@ -507,13 +806,19 @@ exit(int status)
   iput(p->cwd);
   end_op();
   p->cwd = 0;
+  execrelease(p);
+  mmaprelease(p);
+  shmdisown(p);
 
-  acquire(&wait_lock);
+  acquirewrite(&wait_lock);
 
   // Give any children to init.
   reparent(p);
 
-  // Parent might be sleeping in wait().
+  // Move to the parent's zombies; it might be
+  // sleeping in wait().
+  sibdel(&p->parent->children, p);
+  sibadd(&p->parent->zombies, p);
   wakeup(p->parent);
 
   acquire(&p->lock);
@@ -521,7 +826,7 @@ exit(int status)
   p->xstate = status;
   p->state = ZOMBIE;
 
-  release(&wait_lock);
+  releasewrite(&wait_lock);
 
   acquire(&tickslock);
   xticks = ticks;
@@ -597,46 +902,40 @@ int
 wait(uint64 addr)
 {
   struct proc *np;
-  int havekids, pid;
+  int pid;
   struct proc *p = myproc();
 
-  acquire(&wait_lock);
+  if(addr != 0)
+    uvmprefault(addr, sizeof(int), 1);
+  acquireread(&wait_lock);
 
   for(;;){
-    // Scan through table looking for exited children.
-    havekids = 0;
-    for(np = proc; np < &proc[NPROC]; np++){
-      if(np->parent == p){
-        // make sure the child isn't still in exit() or swtch().
-        acquire(&np->lock);
-
-        havekids = 1;
-        if(np->state == ZOMBIE){
-          // Found one.
-          pid = np->pid;
-          if(addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
-                                  sizeof(np->xstate)) < 0) {
-            release(&np->lock);
-            release(&wait_lock);
-            return -1;
-          }
-          freeproc(np);
-          release(&np->lock);
-          release(&wait_lock);
-          return pid;
-        }
+    // Any exited child will do.
+    if((np = p->zombies) != 0){
+      // make sure the child isn't still in exit() or swtch().
+      acquire(&np->lock);
+      pid = np->pid;
+      if(addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
+                              sizeof(np->xstate)) < 0) {
         release(&np->lock);
+        releaseread(&wait_lock);
+        return -1;
       }
+      delzombie(np);
+      freeproc(np);
+      release(&np->lock);
+      releaseread(&wait_lock);
+      return pid;
     }
 
     // No point waiting if we don't have any children.
-    if(!havekids || p->killed){
-      release(&wait_lock);
+    if(p->children == 0 || p->killed){
+      releaseread(&wait_lock);
       return -1;
     }
 
     // Wait for a child to exit.
-    sleep(p, &wait_lock);  //DOC: wait-sleep
+    sleepread(p, &wait_lock);  //DOC: wait-sleep
   }
 }
 
@@ -645,43 +944,42 @@ waitpid(int pid, uint64 addr)
 {
   struct proc *np;
   struct proc *p = myproc();
-  int found=0;
 
-  acquire(&wait_lock);
+  if(addr != 0)
+    uvmprefault(addr, sizeof(int), 1);
+  acquireread(&wait_lock);
 
   for(;;){
-    // Scan through table looking for child with pid
-    for(np = proc; np < &proc[NPROC]; np++){
-      if((np->parent == p) && (np->pid == pid)){
-	found = 1;
-        // make sure the child isn't still in exit() or swtch().
-        acquire(&np->lock);
-
-        if(np->state == ZOMBIE){
-           if(addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
-                                  sizeof(np->xstate)) < 0) {
-             release(&np->lock);
-             release(&wait_lock);
-             return -1;
-           }
-           freeproc(np);
-           release(&np->lock);
-           release(&wait_lock);
-           return pid;
-	}
-
+    // Look the pid up, and make sure the child isn't
+    // still in exit() or swtch().
+    if((np = findproc(pid)) != 0 && np->parent != p){
+      release(&np->lock);
+      np = 0;
+    }
+    if(np && np->state == ZOMBIE){
+      if(addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
+                              sizeof(np->xstate)) < 0) {
         release(&np->lock);
+        releaseread(&wait_lock);
+        return -1;
       }
+      delzombie(np);
+      freeproc(np);
+      release(&np->lock);
+      releaseread(&wait_lock);
+      return pid;
     }
+    if(np)
+      release(&np->lock);
 
-    // No point waiting if we don't have any children.
-    if(!found || p->killed){
-      release(&wait_lock);
+    // No point waiting if it isn't our child.
+    if(np == 0 || p->killed){
+      releaseread(&wait_lock);
       return -1;
     }
 
     // Wait for a child to exit.
-    sleep(p, &wait_lock);  //DOC: wait-sleep
+    sleepread(p, &wait_lock);  //DOC: wait-sleep
   }
 }
 
@@ -699,12 +997,13 @@ scheduler(void)
   struct proc *q;
   struct cpu *c = mycpu();
   uint xticks;
-  int min_burst, min_prio;
+  int min_burst, min_prio, ran;
 
   c->proc = 0;
   for(;;){
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
+    ran = 0;
 
     if (sched_policy == SCHED_NPREEMPT_SJF) {
        min_burst = 0x7FFFFFFF;
@@ -712,7 +1011,7 @@ scheduler(void)
        xticks = ticks;
        release(&tickslock);
        q = 0;
-       for(p = proc; p < &proc[NPROC]; p++) {
+       for(p = allproc; p; p = p->next) {
           acquire(&p->lock);
 	  if(p->state == RUNNABLE) {
 	     if (!p->is_batchproc) {
@@ -734,6 +1033,8 @@ scheduler(void)
           q->waittime += (xticks - q->waitstart);
           q->burst_start = xticks;
           c->proc = q;
+          ran = 1;
+          kvmsync();
           swtch(&c->context, &q->context);
 
           // Process is done running for now.
@@ -747,7 +1048,7 @@ scheduler(void)
        acquire(&tickslock);
        xticks = ticks;
        release(&tickslock);
-       for(p = proc; p < &proc[NPROC]; p++) {
+       for(p = allproc; p; p = p->next) {
           acquire(&p->lock);
 	  if(p->state == RUNNABLE) {
 	     p->cpu_usage = p->cpu_usage/2;
@@ -756,7 +1057,7 @@ scheduler(void)
 	  release(&p->lock);
        }
        q = 0;
-       for(p = proc; p < &proc[NPROC]; p++) {
+       for(p = allproc; p; p = p->next) {
           acquire(&p->lock);
           if(p->state == RUNNABLE) {
              if (!p->is_batchproc) {
@@ -778,6 +1079,8 @@ scheduler(void)
           q->waittime += (xticks - q->waitstart);
           q->burst_start = xticks;
           c->proc = q;
+          ran = 1;
+          kvmsync();
           swtch(&c->context, &q->context);
 
           // Process is done running for now.
@@ -787,7 +1090,7 @@ scheduler(void)
        }
     }
     else {
-       for(p = proc; p < &proc[NPROC]; p++) {
+       for(p = allproc; p; p = p->next) {
           if ((sched_policy != SCHED_NPREEMPT_FCFS) && (sched_policy != SCHED_PREEMPT_RR)) break;
           acquire(&tickslock);
           xticks = ticks;
@@ -801,6 +1104,8 @@ scheduler(void)
 	    p->waittime += (xticks - p->waitstart);
 	    p->burst_start = xticks;
             c->proc = p;
+            ran = 1;
+            kvmsync();
             swtch(&c->context, &p->context);
 
             // Process is done running for now.
@@ -810,6 +1115,10 @@ scheduler(void)
           release(&p->lock);
        }
     }
+
+    // Nothing to run: zero a page for kalloc_zeroed().
+    if(!ran)
+      kzeroidle();
   }
 }
 
@@ -876,6 +1185,33 @@ yield(void)
   release(&p->lock);
 }
 
+// Start a kernel thread running fn(), which must not return.
+// It is a process with no user memory, so it never leaves
+// the kernel, and has no parent to wait() for it.
+void
+kthread(char *name, void (*fn)(void))
+{
+  struct proc *p;
+
+  if((p = allocproc()) == 0)
+    panic("kthread");
+  p->kthread = fn;
+  p->context.ra = (uint64)kthreadret;
+  safestrcpy(p->name, name, sizeof(p->name));
+  p->state = RUNNABLE;
+  release(&p->lock);
+}
+
+// A kernel thread's first scheduling swtches here.
+static void
+kthreadret(void)
+{
+  // Still holding p->lock from scheduler.
+  release(&myproc()->lock);
+  myproc()->kthread();
+  panic("kthread returned");
+}
+
 // A fork child's very first scheduling by scheduler()
 // will swtch to forkret.
 void
@@ -1034,7 +1370,7 @@ wakeup(void *chan)
   }
   else xticks = ticks;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
+  for(p = allproc; p; p = p->next) {
     if(p != myproc()){
       acquire(&p->lock);
       if(p->state == SLEEPING && p->chan == chan) {
@@ -1059,7 +1395,7 @@ wakeupone(void *chan)
   }
   else xticks = ticks;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
+  for(p = allproc; p; p = p->next) {
     if(p != myproc()){
       acquire(&p->lock);
       if(p->state == SLEEPING && p->chan == chan) {
@@ -1087,21 +1423,16 @@ kill(int pid)
   xticks = ticks;
   release(&tickslock);
 
-  for(p = proc; p < &proc[NPROC]; p++){
-    acquire(&p->lock);
-    if(p->pid == pid){
-      p->killed = 1;
-      if(p->state == SLEEPING){
-        // Wake process from sleep().
-        p->state = RUNNABLE;
-	p->waitstart = xticks;
-      }
-      release(&p->lock);
-      return 0;
-    }
-    release(&p->lock);
+  if((p = findproc(pid)) == 0)
+    return -1;
+  p->killed = 1;
+  if(p->state == SLEEPING){
+    // Wake process from sleep().
+    p->state = RUNNABLE;
+    p->waitstart = xticks;
   }
-  return -1;
+  release(&p->lock);
+  return 0;
 }
 
 // Copy to either a user address, or kernel address,
@@ -1134,6 +1465,34 @@ either_copyin(void *dst, int user_src, uint64 src, uint64 len)
   }
 }
 
+// Like either_copyout(), for the niov spans of iov.
+int
+either_copyoutv(int user_dst, uint64 dst, struct iovec *iov, int niov)
+{
+  struct proc *p = myproc();
+  if(user_dst)
+    return copyoutv(p->pagetable, dst, iov, niov);
+  for(; niov > 0; iov++, niov--){
+    memmove((char *)dst, iov->base, iov->len);
+    dst += iov->len;
+  }
+  return 0;
+}
+
+// Like either_copyin(), for the niov spans of iov.
+int
+either_copyinv(struct iovec *iov, int niov, int user_src, uint64 src)
+{
+  struct proc *p = myproc();
+  if(user_src)
+    return copyinv(p->pagetable, iov, niov, src);
+  for(; niov > 0; iov++, niov--){
+    memmove(iov->base, (char *)src, iov->len);
+    src += iov->len;
+  }
+  return 0;
+}
+
 // Print a process listing to console.  For debugging.
 // Runs when user types ^P on console.
 // No lock to avoid wedging a stuck machine further.
@@ -1151,7 +1510,7 @@ procdump(void)
   char *state;
 
   printf("\n");
-  for(p = proc; p < &proc[NPROC]; p++){
+  for(p = allproc; p; p = p->next){
     if(p->state == UNUSED)
       continue;
     if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
@@ -1175,13 +1534,14 @@ ps(void)
   [RUNNING]   "run",
   [ZOMBIE]    "zombie"
   };
-  struct proc *p;
+  struct proc *p, *pp;
+  struct procstat st;
   char *state;
   int ppid, pid;
   uint xticks;
 
   printf("\n");
-  for(p = proc; p < &proc[NPROC]; p++){
+  for(p = allproc; p; p = p->next){
     acquire(&p->lock);
     if(p->state == UNUSED) {
       release(&p->lock);
@@ -1193,21 +1553,24 @@ ps(void)
       state = "???";
 
     pid = p->pid;
+    uvmstat(p->pagetable, &st);
+    st.kstack = kstackused(p);
     release(&p->lock);
-    acquire(&wait_lock);
-    if (p->parent) {
-       acquire(&p->parent->lock);
-       ppid = p->parent->pid;
-       release(&p->parent->lock);
+    acquireread(&wait_lock);
+    if ((pp = p->parent) != 0) {
+       acquire(&pp->lock);
+       ppid = pp->pid;
+       release(&pp->lock);
     }
     else ppid = -1;
-    release(&wait_lock);
+    releaseread(&wait_lock);
 
     acquire(&tickslock);
     xticks = ticks;
     release(&tickslock);
 
     printf("pid=%d, ppid=%d, state=%s, cmd=%s, ctime=%d, stime=%d, etime=%d, size=%p", pid, ppid, state, p->name, p->ctime, p->stime, (p->endtime == -1) ? xticks-p->stime : p->endtime-p->stime, p->sz);
+    printf(", rss=%d, shared=%d, swapped=%d, ptpages=%d, kstack=%d", st.rss, st.shared, st.swapped, st.ptpages, st.kstack);
     printf("\n");
   }
   return 0;
@@ -1225,45 +1588,33 @@ pinfo(int pid, uint64 addr)
   [RUNNING]   "run",
   [ZOMBIE]    "zombie"
   };
-  struct proc *p;
+  struct proc *p, *pp;
   char *state;
   uint xticks;
-  int found=0;
 
   if (pid == -1) {
      p = myproc();
      acquire(&p->lock);
-     found=1;
-  }
-  else {
-     for(p = proc; p < &proc[NPROC]; p++){
-       acquire(&p->lock);
-       if((p->state == UNUSED) || (p->pid != pid)) {
-         release(&p->lock);
-         continue;
-       }
-       else {
-         found=1;
-         break;
-       }
-     }
   }
-  if (found) {
+  else p = findproc(pid);
+  if (p) {
      if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
          state = states[p->state];
      else
          state = "???";
 
      pstat.pid = p->pid;
+     uvmstat(p->pagetable, &pstat);
+     pstat.kstack = kstackused(p);
      release(&p->lock);
-     acquire(&wait_lock);
-     if (p->parent) {
-        acquire(&p->parent->lock);
-        pstat.ppid = p->parent->pid;
-        release(&p->parent->lock);
+     acquireread(&wait_lock);
+     if ((pp = p->parent) != 0) {
+        acquire(&pp->lock);
+        pstat.ppid = pp->pid;
+        release(&pp->lock);
      }
      else pstat.ppid = -1;
-     release(&wait_lock);
+     releaseread(&wait_lock);
 
      acquire(&tickslock);
      xticks = ticks;
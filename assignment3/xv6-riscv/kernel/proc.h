@@ -24,6 +24,8 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  uint64 asidgen;             // ASID generation this hart's TLB belongs to
+  uint64 kstackgen;           // kernel stack unmaps this hart's TLB has seen
 };
 
 extern struct cpu cpus[NCPU];
@@ -78,10 +80,32 @@ struct trapframe {
   /* 264 */ uint64 t4;
   /* 272 */ uint64 t5;
   /* 280 */ uint64 t6;
+  /* 288 */ uint64 tlbflush;      // flush TLB when switching satp (no ASIDs)
 };
 
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// A loadable segment of the program a process is running,
+// paged in from the file on demand (see exec.c).
+struct execseg {
+  uint64 vaddr;                // start address (page-aligned)
+  uint64 memsz;                // bytes in memory
+  uint64 off;                  // file offset of the initialised part
+  uint64 filesz;               // bytes of it in the file
+  int flags;                   // ELF_PROG_FLAG_*
+};
+
+// A region of user memory created by mmap() (see mmap.c).
+struct vma {
+  int used;
+  uint64 start;                // page-aligned user address
+  uint64 len;                  // bytes, a multiple of PGSIZE
+  int prot;                    // PROT_*
+  int flags;                   // MAP_*
+  struct file *f;              // mapped file, 0 if MAP_ANONYMOUS
+  uint off;                    // file offset of start
+};
+
 // Per-process state
 struct proc {
   struct spinlock lock;
@@ -95,9 +119,22 @@ struct proc {
   int base_priority;	       // Static base priority
   int priority;		       // Dynamic priority of a process
   int is_batchproc;	       // Is it part of a batch created using forkp
+  uint64 swaphand;             // Next page for the reclaimer to look at
 
-  // wait_lock must be held when using this:
+  // wait_lock must be held when using these; p itself may
+  // also take zombies off its list with a read hold:
   struct proc *parent;         // Parent process
+  struct proc *children;       // Children still running
+  struct proc *zombies;        // Children that have exited
+  struct proc *sibnext;        // Next on parent's children or zombies
+  struct proc *sibprev;        // Previous on it
+
+  // pid_lock must be held when using this:
+  struct proc *pidnext;        // Next in pid hash chain
+
+  // these belong to the process table (see proc.c):
+  struct proc *next;           // Next in list of all procs; never changes
+  struct proc *freenext;       // Next UNUSED proc on free list
 
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
@@ -108,6 +145,17 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  int shm[NSHMPROC];           // Attached shm segment slots (+1), 0 if free
+  struct inode *execip;        // Program file, for demand paging
+  struct execseg seg[NEXECSEG]; // Its loadable segments
+  int nseg;
+  struct vma vma[NVMA];        // mmap() regions
+  uint asid;                   // Address-space ID of pagetable
+  uint64 asidgen;              // ASID generation asid belongs to
+  int tlbflush;                // pagetable changed since last flush
+  struct cpu *tlbcpu;          // CPU that last ran it in user space
+  uint64 pinstart, pinend;     // uvmprefault()ed pages, kept in memory
+  void (*kthread)(void);       // Kernel thread's body, 0 for user processes
 
   int ctime;		       // Creation time
   int stime;		       // Execution start time
@@ -7,4 +7,17 @@ struct procstat {
   int stime;	// Start time
   int etime;	// Execution time
   uint64 size;	// Process size
+  int rss;	// User pages in memory
+  int shared;	// Of those, pages mapped by someone else too
+  int swapped;	// User pages on swap
+  int ptpages;	// Page-table pages
+  int kstack;	// Deepest kernel stack use, in bytes
+};
+
+// System-wide page counts, from meminfo().
+struct meminfo {
+  int total;	// Pages of RAM the allocator manages
+  int free;	// Of those, free
+  int swap;	// Pages of swap space
+  int swapfree;	// Of those, free
 };
@@ -198,6 +198,10 @@ w_pmpaddr0(uint64 x)
 
 #define MAKE_SATP(pagetable) (SATP_SV39 | (((uint64)pagetable) >> 12))
 
+// address-space ID field of satp.
+#define SATP_ASIDMASK 0xFFFFL
+#define SATP_ASID(asid) (((uint64)(asid) & SATP_ASIDMASK) << 44)
+
 // supervisor address translation and protection;
 // holds the address of the page table.
 static inline void 
@@ -260,6 +264,21 @@ r_mcounteren()
   return x;
 }
 
+// Supervisor Counter-Enable
+static inline void 
+w_scounteren(uint64 x)
+{
+  asm volatile("csrw scounteren, %0" : : "r" (x));
+}
+
+static inline uint64
+r_scounteren()
+{
+  uint64 x;
+  asm volatile("csrr %0, scounteren" : "=r" (x) );
+  return x;
+}
+
 // machine-mode cycle counter
 static inline uint64
 r_time()
@@ -331,18 +350,39 @@ sfence_vma()
   asm volatile("sfence.vma zero, zero");
 }
 
+// flush the TLB entries of one address space.
+static inline void
+sfence_vma_asid(uint64 asid)
+{
+  asm volatile("sfence.vma zero, %0" : : "r" (asid));
+}
+
 
 #define PGSIZE 4096 // bytes per page
 #define PGSHIFT 12  // bits of offset within a page
+#define CACHELINE 64 // bytes per cache line
 
 #define PGROUNDUP(sz)  (((sz)+PGSIZE-1) & ~(PGSIZE-1))
 #define PGROUNDDOWN(a) (((a)) & ~(PGSIZE-1))
 
+#define MEGAPGSIZE (PGSIZE*512) // bytes per megapage (a level-1 leaf)
+
 #define PTE_V (1L << 0) // valid
 #define PTE_R (1L << 1)
 #define PTE_W (1L << 2)
 #define PTE_X (1L << 3)
 #define PTE_U (1L << 4) // 1 -> user can access
+#define PTE_A (1L << 6) // accessed since the bit was last cleared
+#define PTE_D (1L << 7) // dirty
+#define PTE_COW (1L << 8) // RSW: copy-on-write; write-enable on a store fault
+
+// when PTE_V is clear the hardware ignores the rest of a PTE,
+// so a user page that is not in memory keeps its flags and
+// says where its contents are.
+#define PTE_SWAP  (1L << 62) // on swap; the PPN field is the slot
+#define PTE_EVICT (1L << 61) // being written to swap; still holds its page
+#define SWAPPTE(slot, pte) ((((uint64)(slot)) << 10) | PTE_SWAP | (PTE_FLAGS(pte) & ~PTE_V))
+#define PTE2SLOT(pte) (((pte) & ~PTE_SWAP) >> 10)
 
 // shift a physical address to the right place for a PTE.
 #define PA2PTE(pa) ((((uint64)pa) >> 12) << 10)
@@ -0,0 +1,179 @@
+// Reader-writer locks.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "proc.h"
+#include "defs.h"
+#include "rwlock.h"
+
+void
+initrwlock(struct rwspinlock *rw, char *name)
+{
+  initlock(&rw->lk, name);
+  rw->readers = 0;
+  rw->wwait = 0;
+  rw->writer = 0;
+}
+
+// Acquire rw for reading.  Spins while a writer
+// holds it or is waiting for it.
+void
+acquireread(struct rwspinlock *rw)
+{
+  push_off(); // disable interrupts to avoid deadlock.
+  acquire(&rw->lk);
+  while(rw->writer || rw->wwait){
+    release(&rw->lk);
+    while(*(volatile struct cpu**)&rw->writer || *(volatile int*)&rw->wwait)
+      ;
+    acquire(&rw->lk);
+  }
+  rw->readers++;
+  release(&rw->lk);
+}
+
+void
+releaseread(struct rwspinlock *rw)
+{
+  acquire(&rw->lk);
+  if(rw->readers <= 0)
+    panic("releaseread");
+  rw->readers--;
+  release(&rw->lk);
+  pop_off();
+}
+
+// Acquire rw for writing.  Spins until the
+// readers and any other writer have left.
+void
+acquirewrite(struct rwspinlock *rw)
+{
+  push_off(); // disable interrupts to avoid deadlock.
+  acquire(&rw->lk);
+  if(rw->writer == mycpu())
+    panic("acquirewrite");
+  rw->wwait++;
+  while(rw->writer || rw->readers){
+    release(&rw->lk);
+    while(*(volatile struct cpu**)&rw->writer || *(volatile int*)&rw->readers)
+      ;
+    acquire(&rw->lk);
+  }
+  rw->wwait--;
+  rw->writer = mycpu();
+  release(&rw->lk);
+}
+
+void
+releasewrite(struct rwspinlock *rw)
+{
+  acquire(&rw->lk);
+  if(rw->writer != mycpu())
+    panic("releasewrite");
+  rw->writer = 0;
+  release(&rw->lk);
+  pop_off();
+}
+
+// Check whether this cpu holds rw for writing.
+// Interrupts must be off.
+int
+holdingwrite(struct rwspinlock *rw)
+{
+  return rw->writer == mycpu();
+}
+
+// Atomically give up a read hold on rw and sleep on chan.
+// Holds rw for reading again when awakened.  Writers are
+// kept out until sleep() holds p->lock, so a writer's
+// wakeup(chan) can't be missed.
+void
+sleepread(void *chan, struct rwspinlock *rw)
+{
+  acquire(&rw->lk);
+  if(rw->readers <= 0)
+    panic("sleepread");
+  rw->readers--;
+  pop_off(); // acquireread's; rw->lk keeps interrupts off.
+  sleep(chan, &rw->lk);
+  while(rw->writer || rw->wwait){
+    release(&rw->lk);
+    while(*(volatile struct cpu**)&rw->writer || *(volatile int*)&rw->wwait)
+      ;
+    acquire(&rw->lk);
+  }
+  push_off();
+  rw->readers++;
+  release(&rw->lk);
+}
+
+void
+initrwsleeplock(struct rwsleeplock *rw, char *name)
+{
+  initlock(&rw->lk, "rwsleep lock");
+  rw->name = name;
+  rw->readers = 0;
+  rw->wwait = 0;
+  rw->writer = 0;
+  rw->pid = 0;
+}
+
+void
+acquirereadsleep(struct rwsleeplock *rw)
+{
+  acquire(&rw->lk);
+  while(rw->writer || rw->wwait)
+    sleep(rw, &rw->lk);
+  rw->readers++;
+  release(&rw->lk);
+}
+
+void
+releasereadsleep(struct rwsleeplock *rw)
+{
+  acquire(&rw->lk);
+  if(rw->readers <= 0)
+    panic("releasereadsleep");
+  if(--rw->readers == 0)
+    wakeup(rw);
+  release(&rw->lk);
+}
+
+void
+acquirewritesleep(struct rwsleeplock *rw)
+{
+  acquire(&rw->lk);
+  rw->wwait++;
+  while(rw->writer || rw->readers)
+    sleep(rw, &rw->lk);
+  rw->wwait--;
+  rw->writer = 1;
+  rw->pid = myproc()->pid;
+  release(&rw->lk);
+}
+
+void
+releasewritesleep(struct rwsleeplock *rw)
+{
+  acquire(&rw->lk);
+  if(!rw->writer || rw->pid != myproc()->pid)
+    panic("releasewritesleep");
+  rw->writer = 0;
+  rw->pid = 0;
+  wakeup(rw);
+  release(&rw->lk);
+}
+
+int
+holdingwritesleep(struct rwsleeplock *rw)
+{
+  int r;
+
+  acquire(&rw->lk);
+  r = rw->writer && (rw->pid == myproc()->pid);
+  release(&rw->lk);
+  return r;
+}
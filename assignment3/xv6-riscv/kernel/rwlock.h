@@ -0,0 +1,25 @@
+// Reader-writer locks: any number of readers, or one writer.
+// Waiting writers hold off new readers, so a steady stream
+// of readers cannot starve a writer.
+
+// Spinning variant.  Like a spinlock, holders keep interrupts
+// off, must not sleep (except through sleepread()), and must
+// not re-acquire the lock they hold.
+struct rwspinlock {
+  struct spinlock lk; // protects the fields below
+  int readers;        // Number of readers holding the lock.
+  int wwait;          // Number of writers waiting.
+  struct cpu *writer; // The cpu holding it for writing, or 0.
+};
+
+// Sleeping variant, for long-term holds.
+struct rwsleeplock {
+  struct spinlock lk; // protects the fields below
+  int readers;        // Number of readers holding the lock.
+  int wwait;          // Number of writers waiting.
+  int writer;         // Is it held for writing?
+
+  // For debugging:
+  char *name;         // Name of lock.
+  int pid;            // Process holding it for writing.
+};
@@ -0,0 +1,315 @@
+// Shared memory segments and futexes.
+//
+// A segment is a set of physical pages that shmat() maps into the
+// page table of every process that attaches it, so the processes
+// can communicate through ordinary loads and stores.  Segments are
+// attached at fixed per-process windows (SHMVA(i)) below the
+// trapframe, are inherited across fork(), and are detached on
+// exec() and exit().  A segment is freed when its last process
+// detaches, or when the process that created it exits if no
+// process is attached then.  A segment id includes a generation
+// count, so an id for a freed segment does not attach whatever
+// segment reuses its slot.
+//
+// futex_wait()/futex_wake() let user code sleep on an int in
+// memory until another process changes it.  Sleepers are keyed by
+// the physical address of the int, so they meet even when the
+// page is mapped at different virtual addresses.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+struct shmseg {
+  int used;
+  int key;                    // user-chosen name, 0 if private
+  int npages;
+  int nattach;                // number of processes attached
+  int creator;                // pid of its creator, 0 once that exits
+  int gen;                    // bumped each time the slot is reused
+  char *pages[SHM_MAXPAGES];
+};
+
+static struct {
+  struct spinlock lock;
+  struct shmseg seg[NSHM];
+} shmtable;
+
+// A segment's id is its slot number plus NSHM times its
+// generation, kept small enough that ids stay positive.
+#define SHMID(s)  ((s)->gen * NSHM + ((s) - shmtable.seg))
+#define SHMMAXGEN (0x7fffffff / NSHM)
+
+// serialises futex_wait's value check against futex_wake.
+static struct spinlock futex_lock;
+
+void
+shminit(void)
+{
+  initlock(&shmtable.lock, "shmtable");
+  initlock(&futex_lock, "futex");
+}
+
+static void
+freepages(char **pages, int n)
+{
+  for(int i = 0; i < n; i++)
+    if(pages[i])
+      kfree(pages[i]);
+}
+
+// Return the id of the segment named key, creating it with
+// room for size bytes if it does not exist.  A key of 0 always
+// creates a new segment.  Returns -1 on failure.
+int
+shmget(int key, int size)
+{
+  struct shmseg *s;
+  char *pages[SHM_MAXPAGES];
+  int i, npages, id;
+
+  npages = PGROUNDUP((uint64)size) / PGSIZE;
+  if(size <= 0 || npages > SHM_MAXPAGES)
+    return -1;
+
+  memset(pages, 0, sizeof(pages));
+  for(i = 0; i < npages; i++){
+    if((pages[i] = kalloc_zeroed()) == 0){
+      freepages(pages, i);
+      return -1;
+    }
+  }
+
+  acquire(&shmtable.lock);
+  if(key != 0){
+    for(s = shmtable.seg; s < &shmtable.seg[NSHM]; s++){
+      if(s->used && s->key == key){
+        release(&shmtable.lock);
+        freepages(pages, npages);
+        return (s->npages < npages) ? -1 : SHMID(s);
+      }
+    }
+  }
+  for(s = shmtable.seg; s < &shmtable.seg[NSHM]; s++){
+    if(!s->used){
+      s->used = 1;
+      s->key = key;
+      s->npages = npages;
+      s->nattach = 0;
+      s->creator = myproc()->pid;
+      s->gen = (s->gen + 1) % SHMMAXGEN;
+      memmove(s->pages, pages, sizeof(pages));
+      id = SHMID(s);
+      release(&shmtable.lock);
+      return id;
+    }
+  }
+  release(&shmtable.lock);
+  freepages(pages, npages);
+  return -1;
+}
+
+// Drop one attachment of s, freeing its pages with the last one.
+static void
+shmput(struct shmseg *s)
+{
+  char *pages[SHM_MAXPAGES];
+  int npages = 0;
+
+  acquire(&shmtable.lock);
+  if(--s->nattach == 0){
+    npages = s->npages;
+    memmove(pages, s->pages, sizeof(pages));
+    s->used = 0;
+  }
+  release(&shmtable.lock);
+  freepages(pages, npages);
+}
+
+// Map segment s into pagetable at SHMVA(slot).
+static int
+shmmap(pagetable_t pagetable, int slot, struct shmseg *s)
+{
+  uint64 va = SHMVA(slot);
+
+  for(int i = 0; i < s->npages; i++){
+    if(mappages(pagetable, va + i*PGSIZE, PGSIZE, (uint64)s->pages[i],
+                PTE_R|PTE_W|PTE_U) != 0){
+      uvmunmap(pagetable, va, i, 0);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Attach segment id to the current process.
+// Returns the user address it is mapped at, or -1.
+uint64
+shmat(int id)
+{
+  struct proc *p = myproc();
+  struct shmseg *s;
+  int slot;
+
+  if(id < 0)
+    return -1;
+  for(slot = 0; slot < NSHMPROC; slot++)
+    if(p->shm[slot] == 0)
+      break;
+  if(slot == NSHMPROC)
+    return -1;
+
+  s = &shmtable.seg[id % NSHM];
+  acquire(&shmtable.lock);
+  if(!s->used || s->gen != id / NSHM){
+    release(&shmtable.lock);
+    return -1;
+  }
+  s->nattach++;
+  release(&shmtable.lock);
+
+  if(shmmap(p->pagetable, slot, s) < 0){
+    shmput(s);
+    return -1;
+  }
+  p->shm[slot] = s - shmtable.seg + 1;
+  return SHMVA(slot);
+}
+
+static void
+shmunmap(struct proc *p, int slot)
+{
+  struct shmseg *s = &shmtable.seg[p->shm[slot] - 1];
+
+  uvmunmap(p->pagetable, SHMVA(slot), s->npages, 0);
+  p->shm[slot] = 0;
+  shmput(s);
+}
+
+// Detach the segment attached at user address va.
+int
+shmdt(uint64 va)
+{
+  struct proc *p = myproc();
+
+  for(int slot = 0; slot < NSHMPROC; slot++){
+    if(p->shm[slot] && SHMVA(slot) == va){
+      shmunmap(p, slot);
+      return 0;
+    }
+  }
+  return -1;
+}
+
+// Give child np the same attachments as p.
+// Returns 0 on success, -1 on failure; on failure the
+// caller's freeproc() releases what was attached.
+int
+shmfork(struct proc *p, struct proc *np)
+{
+  struct shmseg *s;
+
+  for(int slot = 0; slot < NSHMPROC; slot++){
+    if(p->shm[slot] == 0)
+      continue;
+    s = &shmtable.seg[p->shm[slot] - 1];
+    acquire(&shmtable.lock);
+    s->nattach++;
+    release(&shmtable.lock);
+    if(shmmap(np->pagetable, slot, s) < 0){
+      shmput(s);
+      return -1;
+    }
+    np->shm[slot] = p->shm[slot];
+  }
+  return 0;
+}
+
+// Detach every segment from p's page table.
+// Called from exec() and freeproc().
+void
+shmrelease(struct proc *p)
+{
+  for(int slot = 0; slot < NSHMPROC; slot++)
+    if(p->shm[slot])
+      shmunmap(p, slot);
+}
+
+// p is exiting: free the segments it created that no process
+// is attached to.  Those it is attached to go when the last
+// process detaches, as usual.
+void
+shmdisown(struct proc *p)
+{
+  struct shmseg *s;
+  char *pages[SHM_MAXPAGES];
+  int npages;
+
+  for(s = shmtable.seg; s < &shmtable.seg[NSHM]; s++){
+    npages = 0;
+    acquire(&shmtable.lock);
+    if(s->used && s->creator == p->pid){
+      s->creator = 0;
+      if(s->nattach == 0){
+        npages = s->npages;
+        memmove(pages, s->pages, sizeof(pages));
+        s->used = 0;
+      }
+    }
+    release(&shmtable.lock);
+    freepages(pages, npages);
+  }
+}
+
+// Translate user address va to the kernel address of the int
+// it names, or 0 if it is unmapped or misaligned.
+static int*
+futexaddr(uint64 va)
+{
+  uint64 pa;
+
+  if(va % sizeof(int))
+    return 0;
+  if((pa = walkaddr(myproc()->pagetable, PGROUNDDOWN(va))) == 0)
+    return 0;
+  return (int*)(pa + (va - PGROUNDDOWN(va)));
+}
+
+// Sleep until woken by futex_wake(), provided the int at
+// va still holds val.  Returns 0 after sleeping, -1 if the
+// value had already changed or va is bad.  Callers must
+// re-check their condition: wakeups may be spurious.
+int
+futex_wait(uint64 va, int val)
+{
+  int *addr;
+
+  if((addr = futexaddr(va)) == 0)
+    return -1;
+  acquire(&futex_lock);
+  if(*(volatile int*)addr != val || myproc()->killed){
+    release(&futex_lock);
+    return -1;
+  }
+  sleep(addr, &futex_lock);
+  release(&futex_lock);
+  return 0;
+}
+
+// Wake the processes sleeping in futex_wait() on va.
+int
+futex_wake(uint64 va)
+{
+  int *addr;
+
+  if((addr = futexaddr(va)) == 0)
+    return -1;
+  acquire(&futex_lock);
+  wakeup(addr);
+  release(&futex_lock);
+  return 0;
+}
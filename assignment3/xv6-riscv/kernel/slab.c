@@ -0,0 +1,228 @@
+// Slab allocator: caches of fixed-size kernel objects.
+//
+// Each slab is one page: a struct slab header, with a link
+// for each object, followed by perslab objects.  The free
+// objects are chained through the links, not through the
+// objects themselves, which keep their constructed state.
+// The slab owning an object is found by rounding the
+// object's address down to a page.  A cache keeps its slabs
+// with free objects on a list, and keeps at most one
+// completely empty slab, returning others to kalloc.
+//
+// Objects are constructed (ctor) once, when their slab is
+// created, and must be freed in their constructed state, so
+// e.g. the locks inside them are initialised only once.
+//
+// In front of the slabs, each CPU has a magazine of free
+// objects, used with interrupts off and no lock; it refills
+// from or flushes to the slabs half a magazine at a time.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "slab.h"
+
+struct slab {
+  struct slab *next;       // on cache's partial list
+  struct slab *prev;
+  struct slab_cache *cache;
+  int inuse;               // objects allocated from this slab
+  int free;                // index of first free object, or -1
+  short link[];            // index of next free object, or -1
+};
+
+#define SLAB_OBJ0(s)   ((char*)(s) + (s)->cache->hdr)
+#define SLAB_OBJ(s, i) (SLAB_OBJ0(s) + (i) * (s)->cache->size)
+
+#define NSLABCACHE 8
+static struct slab_cache *slabcaches[NSLABCACHE];
+static int nslabcaches;
+
+// Initialise cache c for objects of size bytes.
+// Called at boot, before other CPUs start.
+void
+slab_cache_init(struct slab_cache *c, char *name, uint size, void (*ctor)(void*))
+{
+  memset(c, 0, sizeof(*c));
+  initlock(&c->lock, "slab");
+  c->name = name;
+  c->size = (size + 7) & ~7;
+  if(c->size < sizeof(void*))
+    c->size = sizeof(void*);
+  c->perslab = (PGSIZE - sizeof(struct slab)) / (c->size + sizeof(short));
+  for(;;){
+    if(c->perslab < 1)
+      panic("slab_cache_init: object too big");
+    c->hdr = (sizeof(struct slab) + c->perslab * sizeof(short) + 7) & ~7;
+    if(c->hdr + c->perslab * c->size <= PGSIZE)
+      break;
+    c->perslab--;
+  }
+  c->ctor = ctor;
+  if(nslabcaches < NSLABCACHE)
+    slabcaches[nslabcaches++] = c;
+}
+
+static void
+slab_unlink(struct slab_cache *c, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    c->partial = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+  s->next = s->prev = 0;
+}
+
+static void
+slab_link(struct slab_cache *c, struct slab *s)
+{
+  s->prev = 0;
+  s->next = c->partial;
+  if(c->partial)
+    c->partial->prev = s;
+  c->partial = s;
+}
+
+// Make a new slab for c.  Returns 0 if out of memory.
+static struct slab*
+slab_grow(struct slab_cache *c)
+{
+  struct slab *s;
+  int i;
+
+  if((s = (struct slab*)kalloc()) == 0)
+    return 0;
+  s->next = s->prev = 0;
+  s->cache = c;
+  s->inuse = 0;
+  s->free = 0;
+  for(i = 0; i < c->perslab; i++){
+    if(c->ctor)
+      c->ctor(SLAB_OBJ(s, i));
+    s->link[i] = i + 1 < c->perslab ? i + 1 : -1;
+  }
+  return s;
+}
+
+// Move up to n objects from c's slabs into magazine m.
+// Caller must hold c->lock.
+static void
+slab_fill(struct slab_cache *c, struct slab_mag *m, int n)
+{
+  struct slab *s;
+  void *obj;
+
+  while(n > 0 && (s = c->partial) != 0){
+    obj = SLAB_OBJ(s, s->free);
+    s->free = s->link[s->free];
+    if(s->inuse++ == 0)
+      c->nempty--;
+    if(s->free < 0)
+      slab_unlink(c, s);
+    m->obj[m->n++] = obj;
+    n--;
+  }
+}
+
+// Return obj to its slab.  Caller must hold c->lock.
+// Returns a slab page for the caller to kfree, or 0.
+static struct slab*
+slab_put(struct slab_cache *c, void *obj)
+{
+  struct slab *s = (struct slab*)PGROUNDDOWN((uint64)obj);
+  int i;
+
+  if(s->cache != c)
+    panic("slab_put");
+  i = ((char*)obj - SLAB_OBJ0(s)) / c->size;
+  if(s->free < 0)
+    slab_link(c, s);
+  s->link[i] = s->free;
+  s->free = i;
+  if(--s->inuse == 0){
+    if(c->nempty > 0){
+      slab_unlink(c, s);
+      c->nslabs--;
+      return s;
+    }
+    c->nempty++;
+  }
+  return 0;
+}
+
+// Allocate an object from cache c.
+// Returns 0 if out of memory.
+void*
+slab_alloc(struct slab_cache *c)
+{
+  struct slab_mag *m;
+  struct slab *s;
+  void *obj = 0;
+
+  push_off();
+  m = &c->mag[cpuid()];
+  if(m->n == 0){
+    acquire(&c->lock);
+    if(c->partial == 0){
+      release(&c->lock);
+      s = slab_grow(c);
+      acquire(&c->lock);
+      if(s){
+        slab_link(c, s);
+        c->nslabs++;
+        c->nempty++;
+      }
+    }
+    slab_fill(c, m, SLAB_MAGSIZE / 2);
+    release(&c->lock);
+  }
+  if(m->n > 0){
+    obj = m->obj[--m->n];
+    __sync_fetch_and_add(&c->ninuse, 1);
+  }
+  pop_off();
+  return obj;
+}
+
+// Return obj to cache c.
+void
+slab_free(struct slab_cache *c, void *obj)
+{
+  struct slab_mag *m;
+  struct slab *s, *dead[SLAB_MAGSIZE / 2];
+  int i, ndead = 0;
+
+  push_off();
+  m = &c->mag[cpuid()];
+  if(m->n == SLAB_MAGSIZE){
+    acquire(&c->lock);
+    for(i = 0; i < SLAB_MAGSIZE / 2; i++)
+      if((s = slab_put(c, m->obj[--m->n])) != 0)
+        dead[ndead++] = s;
+    release(&c->lock);
+  }
+  m->obj[m->n++] = obj;
+  __sync_fetch_and_sub(&c->ninuse, 1);
+  pop_off();
+
+  for(i = 0; i < ndead; i++)
+    kfree((void*)dead[i]);
+}
+
+// Print each cache's usage to the console.
+void
+slabdump(void)
+{
+  struct slab_cache *c;
+
+  for(int i = 0; i < nslabcaches; i++){
+    c = slabcaches[i];
+    printf("slab %s: size %d, %d in use, %d slabs (%d empty), %d per slab\n",
+           c->name, c->size, c->ninuse, c->nslabs, c->nempty, c->perslab);
+  }
+}
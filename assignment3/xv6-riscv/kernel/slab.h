@@ -0,0 +1,27 @@
+// Object caches for fixed-size kernel objects.
+// A cache carves kalloc()'d pages ("slabs") into objects of
+// one size; each CPU keeps a magazine of recently freed
+// objects so most allocations and frees take no lock.
+
+#define SLAB_MAGSIZE  16   // objects per per-CPU magazine
+
+struct slab;
+
+struct slab_mag {
+  int n;                   // objects in obj[]
+  void *obj[SLAB_MAGSIZE];
+};
+
+struct slab_cache {
+  struct spinlock lock;    // protects the slab lists and counters
+  char *name;
+  uint size;               // object size, rounded up to 8 bytes
+  int perslab;             // objects per slab page
+  uint hdr;                // bytes of slab header, with its links
+  void (*ctor)(void*);     // run once on each new object, or 0
+  struct slab *partial;    // slabs with free objects
+  int nslabs;              // slab pages held
+  int nempty;              // slabs with no objects in use
+  int ninuse;              // objects handed out (incl. magazines)
+  struct slab_mag mag[NCPU];
+};
@@ -8,6 +8,7 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "sleeplock.h"
+#include "lockstat.h"
 
 void
 initsleeplock(struct sleeplock *lk, char *name)
@@ -16,17 +17,29 @@ initsleeplock(struct sleeplock *lk, char *name)
   lk->name = name;
   lk->locked = 0;
   lk->pid = 0;
+  lk->stat = lockstat_lookup(name, LOCK_SLEEP);
 }
 
 void
 acquiresleep(struct sleeplock *lk)
 {
+  uint64 t0 = 0;
+  int waited = 0;
+
   acquire(&lk->lk);
+  if(LOCKSTAT && lk->stat)
+    t0 = r_time();
   while (lk->locked) {
+    waited = 1;
     sleep(lk, &lk->lk);
   }
   lk->locked = 1;
   lk->pid = myproc()->pid;
+  if(lk->stat){
+    if(LOCKSTAT)
+      lk->tacquire = r_time();
+    lockstat_acquired(lk->stat, waited, 0, lk->tacquire - t0);
+  }
   release(&lk->lk);
 }
 
@@ -34,6 +47,8 @@ void
 releasesleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);
+  if(LOCKSTAT && lk->stat)
+    lockstat_released(lk->stat, r_time() - lk->tacquire);
   lk->locked = 0;
   lk->pid = 0;
   wakeup(lk);
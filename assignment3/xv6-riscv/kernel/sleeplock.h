@@ -6,5 +6,9 @@ struct sleeplock {
   // For debugging:
   char *name;        // Name of lock.
   int pid;           // Process holding lock
+
+  // For contention statistics (see lockstat.h):
+  struct lockstat *stat; // Counters shared by locks of this name.
+  uint64 tacquire;   // Time (time CSR) of the current acquisition.
 };
 
@@ -7,6 +7,91 @@
 #include "riscv.h"
 #include "proc.h"
 #include "defs.h"
+#include "lockstat.h"
+
+static struct lockstat lockstats[NLOCKSTAT];
+static uint lockstats_busy;
+
+// Find (or create) the counters for locks of the given
+// type named name.  Can't use acquire() here, since
+// acquire() uses the result, so spin on a bare flag instead.
+struct lockstat*
+lockstat_lookup(char *name, int type)
+{
+  struct lockstat *st;
+
+  push_off();
+  while(__sync_lock_test_and_set(&lockstats_busy, 1) != 0)
+    ;
+  __sync_synchronize();
+  for(st = lockstats; st < &lockstats[NLOCKSTAT-1]; st++){
+    if(st->name[0] == 0){
+      safestrcpy(st->name, name, sizeof(st->name));
+      st->type = type;
+      break;
+    }
+    if(st->type == type && strncmp(st->name, name, sizeof(st->name)-1) == 0)
+      break;
+  }
+  if(st->name[0] == 0){
+    // table full; lump the rest together.
+    safestrcpy(st->name, "(other)", sizeof(st->name));
+    st->type = type;
+  }
+  __sync_synchronize();
+  __sync_lock_release(&lockstats_busy);
+  pop_off();
+  return st;
+}
+
+// Count one acquisition of a lock with counters st, which
+// was contended, spun spins times and waited for wait cycles
+// (always 0 unless LOCKSTAT).
+void
+lockstat_acquired(struct lockstat *st, int contended, uint64 spins, uint64 wait)
+{
+  if(st == 0)
+    return;
+  __sync_fetch_and_add(&st->nacquire, 1);
+  if(contended){
+    __sync_fetch_and_add(&st->ncontended, 1);
+    __sync_fetch_and_add(&st->nspin, spins);
+    if(LOCKSTAT)
+      __sync_fetch_and_add(&st->waitcycles, wait);
+  }
+}
+
+// Note that a lock with counters st was held for held cycles.
+void
+lockstat_released(struct lockstat *st, uint64 held)
+{
+  uint64 max;
+
+  if(st == 0)
+    return;
+  while((max = st->maxhold) < held &&
+        !__sync_bool_compare_and_swap(&st->maxhold, max, held))
+    ;
+}
+
+// Copy up to n lockstat entries to user address addr.
+// Returns the number copied, or -1.
+int
+lockstat_copyout(uint64 addr, int n)
+{
+  struct lockstat *st;
+  int i = 0;
+
+  for(st = lockstats; st < &lockstats[NLOCKSTAT] && i < n; st++){
+    if(st->name[0] == 0)
+      continue;
+    if(copyout(myproc()->pagetable, addr + i*sizeof(*st),
+               (char*)st, sizeof(*st)) < 0)
+      return -1;
+    i++;
+  }
+  return i;
+}
 
 void
 initlock(struct spinlock *lk, char *name)
@@ -14,6 +99,20 @@ initlock(struct spinlock *lk, char *name)
   lk->name = name;
   lk->locked = 0;
   lk->cpu = 0;
+  lk->ticket = 0;
+  lk->next = 0;
+  lk->serving = 0;
+  lk->stat = lockstat_lookup(name, LOCK_SPIN);
+}
+
+// Initialize a ticket lock: fair (FIFO) and friendlier to
+// the cache under contention than the default test-and-set
+// lock, at the cost of an extra atomic per acquire.
+void
+initticketlock(struct spinlock *lk, char *name)
+{
+  initlock(lk, name);
+  lk->ticket = 1;
 }
 
 // Acquire the lock.
@@ -21,16 +120,30 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  uint64 spins = 0, t0 = 0;
+
   push_off(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
-  // On RISC-V, sync_lock_test_and_set turns into an atomic swap:
-  //   a5 = 1
-  //   s1 = &lk->locked
-  //   amoswap.w.aq a5, a5, (s1)
-  while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
-    ;
+  if(LOCKSTAT && lk->stat)
+    t0 = r_time();
+
+  if(lk->ticket){
+    // Take a ticket, then wait for it to be served.
+    // On RISC-V, sync_fetch_and_add turns into amoadd.w.
+    uint t = __sync_fetch_and_add(&lk->next, 1);
+    while(*(volatile uint*)&lk->serving != t)
+      spins++;
+    lk->locked = 1;
+  } else {
+    // On RISC-V, sync_lock_test_and_set turns into an atomic swap:
+    //   a5 = 1
+    //   s1 = &lk->locked
+    //   amoswap.w.aq a5, a5, (s1)
+    while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
+      spins++;
+  }
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -40,6 +153,12 @@ acquire(struct spinlock *lk)
 
   // Record info about lock acquisition for holding() and debugging.
   lk->cpu = mycpu();
+
+  if(lk->stat){
+    if(LOCKSTAT)
+      lk->tacquire = r_time();
+    lockstat_acquired(lk->stat, spins != 0, spins, lk->tacquire - t0);
+  }
 }
 
 // Release the lock.
@@ -49,6 +168,9 @@ release(struct spinlock *lk)
   if(!holding(lk))
     panic("release");
 
+  if(LOCKSTAT && lk->stat)
+    lockstat_released(lk->stat, r_time() - lk->tacquire);
+
   lk->cpu = 0;
 
   // Tell the C compiler and the CPU to not move loads or stores
@@ -68,6 +190,10 @@ release(struct spinlock *lk)
   //   amoswap.w zero, zero, (s1)
   __sync_lock_release(&lk->locked);
 
+  // A ticket lock is handed to the next waiter in line.
+  if(lk->ticket)
+    __sync_fetch_and_add(&lk->serving, 1);
+
   pop_off();
 }
 
@@ -108,3 +234,24 @@ pop_off(void)
   if(c->noff == 0 && c->intena)
     intr_on();
 }
+
+// Print the lock contention counters to the console.
+// Counters are read without locking, so may be slightly stale.
+void
+lockdump(void)
+{
+  struct lockstat *st;
+
+  printf("\nlock: acquires contended spins%s\n",
+         LOCKSTAT ? " wait maxhold" : "");
+  for(st = lockstats; st < &lockstats[NLOCKSTAT]; st++){
+    if(st->name[0] == 0 || st->nacquire == 0)
+      continue;
+    printf("%s%s: %l %l %l", st->name,
+           st->type == LOCK_SLEEP ? " (sleep)" : "", st->nacquire,
+           st->ncontended, st->nspin);
+    if(LOCKSTAT)
+      printf(" %l %l", st->waitcycles, st->maxhold);
+    printf("\n");
+  }
+}
@@ -2,8 +2,18 @@
 struct spinlock {
   uint locked;       // Is the lock held?
 
+  // Ticket locks hand out tickets and serve them in order,
+  // so waiters acquire in FIFO order and spin on a read
+  // rather than an atomic swap:
+  int ticket;        // Is this a ticket lock? (see initticketlock)
+  uint next;         // Next ticket to hand out.
+  uint serving;      // Ticket now allowed to hold the lock.
+
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
-};
 
+  // For contention statistics (see lockstat.h):
+  struct lockstat *stat; // Counters shared by locks of this name.
+  uint64 tacquire;   // Time (time CSR) of the current acquisition.
+};
@@ -43,6 +43,12 @@ start()
   w_pmpaddr0(0x3fffffffffffffull);
   w_pmpcfg0(0xf);
 
+  // allow supervisor mode to read the time CSR,
+  // for lock hold-time statistics, and user mode
+  // too, for benchmarks like membench.
+  w_mcounteren(r_mcounteren() | 2);
+  w_scounteren(r_scounteren() | 2);
+
   // ask for clock interrupts.
   timerinit();
 
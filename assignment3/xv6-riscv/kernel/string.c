@@ -1,13 +1,44 @@
 #include "types.h"
 
+// memset, memmove and memcmp work a word at a time once
+// the pointers are word-aligned, and memset/memmove do a
+// 64-byte cache line per loop iteration.  When dst and src
+// have different alignments, one of each pair of word accesses
+// would be misaligned, which RISC-V makes slow or traps, so
+// those fall back to bytes.
+
+typedef uint64 __attribute__((__may_alias__)) word;
+
+#define WSIZE       sizeof(word)
+#define LINE        (8*WSIZE)
+#define ALIGNED(p)  (((uint64)(p) & (WSIZE-1)) == 0)
+#define COALIGNED(p, q) ((((uint64)(p) ^ (uint64)(q)) & (WSIZE-1)) == 0)
+
 void*
 memset(void *dst, int c, uint n)
 {
-  char *cdst = (char *) dst;
-  int i;
-  for(i = 0; i < n; i++){
-    cdst[i] = c;
+  uchar *d = dst;
+  word w, *wd;
+
+  while(n > 0 && !ALIGNED(d)){
+    *d++ = c;
+    n--;
+  }
+  if(n >= WSIZE){
+    w = (uchar)c;
+    w |= w << 8;
+    w |= w << 16;
+    w |= w << 32;
+    for(wd = (word*)d; n >= LINE; n -= LINE, wd += 8){
+      wd[0] = w; wd[1] = w; wd[2] = w; wd[3] = w;
+      wd[4] = w; wd[5] = w; wd[6] = w; wd[7] = w;
+    }
+    for(; n >= WSIZE; n -= WSIZE)
+      *wd++ = w;
+    d = (uchar*)wd;
   }
+  while(n-- > 0)
+    *d++ = c;
   return dst;
 }
 
@@ -18,6 +49,14 @@ memcmp(const void *v1, const void *v2, uint n)
 
   s1 = v1;
   s2 = v2;
+  if(COALIGNED(s1, s2)){
+    for(; n > 0 && !ALIGNED(s1); n--, s1++, s2++)
+      if(*s1 != *s2)
+        return *s1 - *s2;
+    // skip the equal words; the bytes find the difference.
+    for(; n >= WSIZE && *(word*)s1 == *(word*)s2; n -= WSIZE)
+      s1 += WSIZE, s2 += WSIZE;
+  }
   while(n-- > 0){
     if(*s1 != *s2)
       return *s1 - *s2;
@@ -27,25 +66,81 @@ memcmp(const void *v1, const void *v2, uint n)
   return 0;
 }
 
+// Copy n bytes from s to d, lowest first.
+// Safe if d is below s even when they overlap.
+static void
+copyup(uchar *d, const uchar *s, uint n)
+{
+  word *wd, a0, a1, a2, a3, a4, a5, a6, a7;
+  const word *ws;
+
+  if(COALIGNED(d, s)){
+    for(; n > 0 && !ALIGNED(d); n--)
+      *d++ = *s++;
+    wd = (word*)d;
+    ws = (const word*)s;
+    for(; n >= LINE; n -= LINE, wd += 8, ws += 8){
+      // load the line before storing any of it, in case
+      // it overlaps.
+      a0 = ws[0]; a1 = ws[1]; a2 = ws[2]; a3 = ws[3];
+      a4 = ws[4]; a5 = ws[5]; a6 = ws[6]; a7 = ws[7];
+      wd[0] = a0; wd[1] = a1; wd[2] = a2; wd[3] = a3;
+      wd[4] = a4; wd[5] = a5; wd[6] = a6; wd[7] = a7;
+    }
+    for(; n >= WSIZE; n -= WSIZE)
+      *wd++ = *ws++;
+    d = (uchar*)wd;
+    s = (const uchar*)ws;
+  }
+  while(n-- > 0)
+    *d++ = *s++;
+}
+
+// Copy the n bytes ending at s to those ending at d,
+// highest first.  Safe if d is above s even when they overlap.
+static void
+copydown(uchar *d, const uchar *s, uint n)
+{
+  word *wd, a0, a1, a2, a3, a4, a5, a6, a7;
+  const word *ws;
+
+  if(COALIGNED(d, s)){
+    for(; n > 0 && !ALIGNED(d); n--)
+      *--d = *--s;
+    wd = (word*)d;
+    ws = (const word*)s;
+    for(; n >= LINE; n -= LINE){
+      wd -= 8;
+      ws -= 8;
+      a0 = ws[0]; a1 = ws[1]; a2 = ws[2]; a3 = ws[3];
+      a4 = ws[4]; a5 = ws[5]; a6 = ws[6]; a7 = ws[7];
+      wd[0] = a0; wd[1] = a1; wd[2] = a2; wd[3] = a3;
+      wd[4] = a4; wd[5] = a5; wd[6] = a6; wd[7] = a7;
+    }
+    for(; n >= WSIZE; n -= WSIZE)
+      *--wd = *--ws;
+    d = (uchar*)wd;
+    s = (const uchar*)ws;
+  }
+  while(n-- > 0)
+    *--d = *--s;
+}
+
 void*
 memmove(void *dst, const void *src, uint n)
 {
-  const char *s;
-  char *d;
+  const uchar *s;
+  uchar *d;
 
   if(n == 0)
     return dst;
   
   s = src;
   d = dst;
-  if(s < d && s + n > d){
-    s += n;
-    d += n;
-    while(n-- > 0)
-      *--d = *--s;
-  } else
-    while(n-- > 0)
-      *d++ = *s++;
+  if(s < d && s + n > d)
+    copydown(d + n, s + n, n);
+  else
+    copyup(d, s, n);
 
   return dst;
 }
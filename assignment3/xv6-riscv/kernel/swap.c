@@ -0,0 +1,360 @@
+// Page reclamation and swap.
+//
+// When free memory runs low, the kswapd kernel thread, or a
+// process about to fault in a page, evicts user pages to the
+// swap area that mkfs leaves after the file system.  Victims
+// are chosen by the clock (second-chance) algorithm: the
+// reclaimer sweeps each process's memory in turn, and a page
+// the hardware has marked accessed since the last sweep just
+// has its PTE_A cleared.
+//
+// Only private pages below p->sz of processes that are not
+// running are evicted: not shared program text, copy-on-write
+// pages, mmap() regions or shm segments.  Eviction takes three
+// steps so that the disk write can sleep without p->lock:
+//   1. under p->lock, the PTE is made invalid and marked
+//      PTE_EVICT; the reclaimer holds a reference to the page.
+//   2. the page is written to a free slot.
+//   3. under p->lock, if the PTE is still the one from step 1,
+//      it becomes a PTE_SWAP entry naming the slot and the page
+//      is freed.
+// A process that touches the page during step 2 takes it back
+// (swaprescue()), so in step 3 the PTE no longer matches and
+// the slot is released.  PTEs leave PTE_EVICT only by
+// compare-and-swap, since the owner may race the reclaimer.
+//
+// The page fault handler reads swapped-out pages back.  fork()
+// shares slots between parent and child, so each slot has a
+// reference count.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+#include "proc.h"
+#include "defs.h"
+
+#define SWAP_LOW   512   // kswapd keeps this many pages free
+#define SWAP_MIN   128   // faulting processes reclaim below this
+#define SWAP_BATCH 32    // pages evicted per pass
+#define SWAP_SCAN  1024  // PTEs looked at per process per pass
+
+#define SLOTBLOCKS (PGSIZE/BSIZE)
+#define NSLOT      (SWAPBLOCKS/SLOTBLOCKS)
+
+// A page chosen in step 1.
+struct victim {
+  struct proc *p;
+  int pid;
+  pagetable_t pagetable;
+  pte_t *pte;
+  pte_t evict;              // *pte as step 1 left it
+};
+
+static struct {
+  struct spinlock lock;     // protects ref[], nused, hint
+  uint start;               // first swap block
+  int nslot;                // 0 until swapinit()
+  int nused;
+  int hint;                 // where to look for a free slot
+  ushort ref[NSLOT];        // PTEs naming each slot
+
+  struct sleeplock reclaim; // one reclaim pass at a time
+  struct proc *hand;        // last process swept
+
+  struct sleeplock io;      // protects buf
+  struct buf buf;           // swap blocks bypass the buffer cache
+  uint64 nout;              // pages written
+  uint64 nin;               // pages read back
+} swap;
+
+// Called by fsinit() with the swap area from the superblock.
+void
+swapinit(uint start, uint nblocks)
+{
+  initlock(&swap.lock, "swap");
+  initsleeplock(&swap.reclaim, "reclaim");
+  initsleeplock(&swap.io, "swapio");
+  swap.start = start;
+  __sync_synchronize();
+  swap.nslot = nblocks / SLOTBLOCKS < NSLOT ? nblocks / SLOTBLOCKS : NSLOT;
+}
+
+static int
+slotalloc(void)
+{
+  int i, s;
+
+  acquire(&swap.lock);
+  for(i = 0; i < swap.nslot; i++){
+    s = (swap.hint + i) % swap.nslot;
+    if(swap.ref[s] == 0){
+      swap.ref[s] = 1;
+      swap.nused++;
+      swap.hint = s + 1;
+      release(&swap.lock);
+      return s;
+    }
+  }
+  release(&swap.lock);
+  return -1;
+}
+
+// Drop a reference to slot s.
+static void
+slotput(int s)
+{
+  acquire(&swap.lock);
+  if(swap.ref[s] == 0)
+    panic("slotput");
+  if(--swap.ref[s] == 0)
+    swap.nused--;
+  release(&swap.lock);
+}
+
+// Read or write the page at pa from or to slot s.
+static void
+swaprw(int s, char *pa, int write)
+{
+  int i;
+
+  acquiresleep(&swap.io);
+  for(i = 0; i < SLOTBLOCKS; i++){
+    swap.buf.dev = ROOTDEV;
+    swap.buf.blockno = swap.start + s*SLOTBLOCKS + i;
+    if(write)
+      memmove(swap.buf.data, pa + i*BSIZE, BSIZE);
+    virtio_disk_rw(&swap.buf, write);
+    if(!write)
+      memmove(pa + i*BSIZE, swap.buf.data, BSIZE);
+  }
+  if(write)
+    swap.nout++;
+  else
+    swap.nin++;
+  releasesleep(&swap.io);
+}
+
+// Step 1: choose up to n pages, carrying on each sweep where
+// the last pass left it.  Returns the number chosen.
+static int
+pick(struct victim *v, int n)
+{
+  struct proc *p;
+  pte_t *pte;
+  uint64 va, pa;
+  int i, k, got = 0;
+
+  for(i = 0; i < nproc && got < n; i++){
+    p = swap.hand = procnext(swap.hand);
+    acquire(&p->lock);
+    if((p->state != RUNNABLE && p->state != SLEEPING) || p->kthread){
+      release(&p->lock);
+      continue;
+    }
+    for(k = 0; k < SWAP_SCAN && got < n && p->sz > 0; k++){
+      if(p->swaphand >= p->sz)
+        p->swaphand = 0;
+      va = p->swaphand;
+      p->swaphand += PGSIZE;
+      if(va >= p->pinstart && va < p->pinend)
+        continue;
+      pte = walk(p->pagetable, va, 0);
+      if(pte == 0 || (*pte & (PTE_V|PTE_U)) != (PTE_V|PTE_U))
+        continue;
+      if(*pte & PTE_A){
+        // second chance.
+        *pte &= ~PTE_A;
+        p->tlbflush = 1;
+        continue;
+      }
+      pa = PTE2PA(*pte);
+      if(krefcount((void*)pa) != 1)
+        continue;
+      krefinc((void*)pa);
+      *pte = (*pte & ~PTE_V) | PTE_EVICT;
+      p->tlbflush = 1;
+      v[got].p = p;
+      v[got].pid = p->pid;
+      v[got].pagetable = p->pagetable;
+      v[got].pte = pte;
+      v[got].evict = *pte;
+      got++;
+    }
+    release(&p->lock);
+  }
+  return got;
+}
+
+// Step 3: point the victim's PTE at slot s, or give the page
+// back if s is -1.  Returns 1 if the page was freed.
+static int
+finish(struct victim *v, int s)
+{
+  struct proc *p = v->p;
+  uint64 pa = PTE2PA(v->evict & ~PTE_EVICT);
+  pte_t new;
+  int done = 0;
+
+  if(s >= 0)
+    new = SWAPPTE(s, v->evict);
+  else
+    new = (v->evict & ~PTE_EVICT) | PTE_V;
+  acquire(&p->lock);
+  // the page table may have been freed by exit() or exec().
+  if(p->pid == v->pid && p->pagetable == v->pagetable)
+    done = __sync_bool_compare_and_swap(v->pte, v->evict, new);
+  release(&p->lock);
+  if(s >= 0 && !done)
+    slotput(s);
+  if(s >= 0 && done)
+    kfree((void*)pa); // the page table's reference
+  kfree((void*)pa);   // step 1's reference
+  return s >= 0 && done;
+}
+
+// Evict up to n pages.  Returns the number freed.
+static int
+reclaim(int n)
+{
+  struct victim v[SWAP_BATCH];
+  int i, s, got, freed = 0;
+
+  if(n > SWAP_BATCH)
+    n = SWAP_BATCH;
+  acquiresleep(&swap.reclaim);
+  got = pick(v, n);
+  for(i = 0; i < got; i++){
+    if((s = slotalloc()) >= 0)
+      swaprw(s, (char*)PTE2PA(v[i].evict & ~PTE_EVICT), 1);
+    freed += finish(&v[i], s);
+  }
+  releasesleep(&swap.reclaim);
+  return freed;
+}
+
+static void
+tick(void)
+{
+  acquire(&tickslock);
+  sleep(&ticks, &tickslock);
+  release(&tickslock);
+}
+
+// Body of the kswapd kernel thread.
+void
+swapd(void)
+{
+  for(;;){
+    if(swap.nslot == 0 || kfreecount() >= SWAP_LOW || reclaim(SWAP_BATCH) == 0)
+      tick();
+  }
+}
+
+// Called before allocating user memory, without spinlocks
+// held.  If free memory is short, evict some pages now, or
+// give kswapd a few ticks to evict this process's own.
+void
+swapthrottle(void)
+{
+  int i;
+
+  for(i = 0; i < 10 && swap.nslot > 0 && kfreecount() < SWAP_MIN; i++)
+    if(reclaim(SWAP_BATCH) == 0)
+      tick();
+}
+
+// If the reclaimer is writing out the page *pte maps, take
+// it back.  Returns 1 if so, 0 if *pte is not being evicted
+// (though it may just have been swapped out).
+int
+swaprescue(pte_t *pte)
+{
+  pte_t old;
+
+  while((old = *pte) & PTE_EVICT)
+    if(__sync_bool_compare_and_swap(pte, old, (old & ~PTE_EVICT) | PTE_V))
+      return 1;
+  return 0;
+}
+
+// Handle a fault by p on the page *pte, which is being
+// evicted or is on swap.  Returns 0 if the access may be
+// retried, -1 if the page could not be brought back.
+int
+swapfault(struct proc *p, pte_t *pte)
+{
+  pte_t old;
+  char *mem;
+
+  if(swaprescue(pte)){
+    p->tlbflush = 1;
+    return 0;
+  }
+  old = *pte;
+  if((old & PTE_SWAP) == 0)
+    return -1;
+  // reading the slot sleeps; see uvmprefault().
+  if(mycpu()->noff > 0)
+    return -1;
+  if((mem = kalloc()) == 0)
+    return -1;
+  swaprw(PTE2SLOT(old), mem, 0);
+  *pte = PA2PTE(mem) | PTE_FLAGS(old) | PTE_V | PTE_A;
+  slotput(PTE2SLOT(old));
+  p->tlbflush = 1;
+  return 0;
+}
+
+// Clear *pte, which is not valid but may hold a page being
+// evicted or name a slot, and drop the page or slot.
+void
+swapunmap(pte_t *pte, int do_free)
+{
+  pte_t old;
+
+  for(;;){
+    old = *pte;
+    if(old & PTE_EVICT){
+      if(!__sync_bool_compare_and_swap(pte, old, 0))
+        continue;
+      if(do_free)
+        kfree((void*)PTE2PA(old & ~PTE_EVICT));
+    } else {
+      *pte = 0;
+      if(old & PTE_SWAP)
+        slotput(PTE2SLOT(old));
+    }
+    return;
+  }
+}
+
+// Return a copy of swapped-out PTE pte for another page table.
+pte_t
+swapdup(pte_t pte)
+{
+  acquire(&swap.lock);
+  swap.ref[PTE2SLOT(pte)]++;
+  release(&swap.lock);
+  return pte;
+}
+
+// Pages of swap space, and how many are free.
+void
+swapcount(int *total, int *free)
+{
+  *total = swap.nslot;
+  *free = swap.nslot - swap.nused;
+}
+
+// Print swap counters.  For ^F on the console.
+void
+swapdump(void)
+{
+  printf("swap: %d of %d slots in use, %d pages out, %d in\n",
+         swap.nused, swap.nslot, (int)swap.nout, (int)swap.nin);
+}
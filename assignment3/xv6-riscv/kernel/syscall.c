@@ -124,6 +124,21 @@ extern uint64 sys_cond_consume(void);
 extern uint64 sys_buffer_sem_init(void);
 extern uint64 sys_sem_produce(void);
 extern uint64 sys_sem_consume(void);
+extern uint64 sys_bqueue_alloc(void);
+extern uint64 sys_produce_many(void);
+extern uint64 sys_consume_many(void);
+extern uint64 sys_bqueue_free(void);
+extern uint64 sys_shmget(void);
+extern uint64 sys_shmat(void);
+extern uint64 sys_shmdt(void);
+extern uint64 sys_futex_wait(void);
+extern uint64 sys_futex_wake(void);
+extern uint64 sys_lockdump(void);
+extern uint64 sys_lockstat(void);
+extern uint64 sys_spawn(void);
+extern uint64 sys_mmap(void);
+extern uint64 sys_munmap(void);
+extern uint64 sys_meminfo(void);
 
 static uint64 (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -167,6 +182,21 @@ static uint64 (*syscalls[])(void) = {
 [SYS_buffer_sem_init]  sys_buffer_sem_init,
 [SYS_sem_produce]  sys_sem_produce,
 [SYS_sem_consume]  sys_sem_consume,
+[SYS_bqueue_alloc]  sys_bqueue_alloc,
+[SYS_produce_many]  sys_produce_many,
+[SYS_consume_many]  sys_consume_many,
+[SYS_bqueue_free]  sys_bqueue_free,
+[SYS_shmget]  sys_shmget,
+[SYS_shmat]   sys_shmat,
+[SYS_shmdt]   sys_shmdt,
+[SYS_futex_wait]  sys_futex_wait,
+[SYS_futex_wake]  sys_futex_wake,
+[SYS_lockdump]  sys_lockdump,
+[SYS_lockstat]  sys_lockstat,
+[SYS_spawn]     sys_spawn,
+[SYS_mmap]      sys_mmap,
+[SYS_munmap]    sys_munmap,
+[SYS_meminfo]   sys_meminfo,
 };
 
 void
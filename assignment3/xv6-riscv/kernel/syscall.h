@@ -40,3 +40,18 @@
 #define SYS_buffer_sem_init 37
 #define SYS_sem_produce 38
 #define SYS_sem_consume 39
+#define SYS_bqueue_alloc 40
+#define SYS_produce_many 41
+#define SYS_consume_many 42
+#define SYS_bqueue_free 43
+#define SYS_shmget 44
+#define SYS_shmat 45
+#define SYS_shmdt 46
+#define SYS_futex_wait 47
+#define SYS_futex_wake 48
+#define SYS_lockdump 49
+#define SYS_lockstat 50
+#define SYS_spawn 51
+#define SYS_mmap 52
+#define SYS_munmap 53
+#define SYS_meminfo 54
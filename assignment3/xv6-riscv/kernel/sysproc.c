@@ -9,6 +9,7 @@
 #include "proc.h"
 #include "condvar.h"
 #include "semaphore.h"
+#include "procstat.h"
 
 static int barri[]={-1,-1,-1,-1,-1,-1,-1,-1,-1,-1};
 static struct cond_t cv_br;
@@ -131,6 +132,85 @@ sys_cond_consume(void){
   return v;
 }
 
+uint64
+sys_bqueue_alloc(void){
+  int cap;
+  if(argint(0, &cap) < 0)
+    return -1;
+  return bqueue_alloc(cap);
+}
+
+uint64
+sys_produce_many(void){
+  int id, n, flags;
+  uint64 items;
+  if(argint(0, &id) < 0 || argaddr(1, &items) < 0)
+    return -1;
+  if(argint(2, &n) < 0 || argint(3, &flags) < 0)
+    return -1;
+  return bqueue_produce(id, items, n, flags);
+}
+
+uint64
+sys_consume_many(void){
+  int id, n, flags;
+  uint64 items;
+  if(argint(0, &id) < 0 || argaddr(1, &items) < 0)
+    return -1;
+  if(argint(2, &n) < 0 || argint(3, &flags) < 0)
+    return -1;
+  return bqueue_consume(id, items, n, flags);
+}
+
+uint64
+sys_bqueue_free(void){
+  int id;
+  if(argint(0, &id) < 0)
+    return -1;
+  return bqueue_free(id);
+}
+
+uint64
+sys_shmget(void){
+  int key, size;
+  if(argint(0, &key) < 0 || argint(1, &size) < 0)
+    return -1;
+  return shmget(key, size);
+}
+
+uint64
+sys_shmat(void){
+  int id;
+  if(argint(0, &id) < 0)
+    return -1;
+  return shmat(id);
+}
+
+uint64
+sys_shmdt(void){
+  uint64 va;
+  if(argaddr(0, &va) < 0)
+    return -1;
+  return shmdt(va);
+}
+
+uint64
+sys_futex_wait(void){
+  uint64 va;
+  int val;
+  if(argaddr(0, &va) < 0 || argint(1, &val) < 0)
+    return -1;
+  return futex_wait(va, val);
+}
+
+uint64
+sys_futex_wake(void){
+  uint64 va;
+  if(argaddr(0, &va) < 0)
+    return -1;
+  return futex_wake(va);
+}
+
 uint64
 sys_barrier_alloc(void){
   initsleeplock(&lock_print,"print");
@@ -221,7 +301,7 @@ sys_wait(void)
 uint64
 sys_sbrk(void)
 {
-  int addr;
+  uint64 addr;
   int n;
 
   if(argint(0, &n) < 0)
@@ -279,11 +359,14 @@ sys_uptime(void)
 uint64
 sys_getppid(void)
 {
-  if (myproc()->parent) return myproc()->parent->pid;
-  else {
-     printf("No parent found.\n");
-     return 0;
-  }
+  struct proc *pp;
+  int ppid = 0;
+
+  acquireread(&wait_lock);
+  if ((pp = myproc()->parent) != 0) ppid = pp->pid;
+  releaseread(&wait_lock);
+  if (pp == 0) printf("No parent found.\n");
+  return ppid;
 }
 
 uint64
@@ -298,6 +381,8 @@ sys_getpa(void)
 {
   uint64 x;
   if (argaddr(0, &x) < 0) return -1;
+  // a lazily allocated page gets its memory now.
+  if (walkaddr(myproc()->pagetable, x) == 0) vmfault(myproc(), x, 0);
   return walkaddr(myproc()->pagetable, x) + (x & (PGSIZE - 1));
 }
 
@@ -346,6 +431,22 @@ sys_pinfo(void)
   return pinfo(x, p);
 }
 
+// How many pages of memory and swap there are, and how
+// many are free.
+uint64
+sys_meminfo(void)
+{
+  struct meminfo mi;
+  uint64 p;
+
+  if(argaddr(0, &p) < 0)
+    return -1;
+  mi.total = ktotalcount();
+  mi.free = kfreecount();
+  swapcount(&mi.swap, &mi.swapfree);
+  return copyout(myproc()->pagetable, p, (char*)&mi, sizeof(mi));
+}
+
 uint64
 sys_forkp(void)
 {
@@ -354,6 +455,24 @@ sys_forkp(void)
   return forkp(x);
 }
 
+uint64
+sys_lockdump(void)
+{
+  lockdump();
+  return 0;
+}
+
+uint64
+sys_lockstat(void)
+{
+  uint64 p;
+  int n;
+
+  if(argaddr(0, &p) < 0 || argint(1, &n) < 0)
+    return -1;
+  return lockstat_copyout(p, n);
+}
+
 uint64
 sys_schedpolicy(void)
 {
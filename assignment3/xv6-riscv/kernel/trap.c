@@ -21,7 +21,7 @@ extern int sched_policy;
 void
 trapinit(void)
 {
-  initlock(&tickslock, "time");
+  initticketlock(&tickslock, "time");
 }
 
 // set up to take exceptions and traps while in the kernel.
@@ -67,6 +67,9 @@ usertrap(void)
     intr_on();
 
     syscall();
+  } else if((r_scause() == 12 || r_scause() == 13 || r_scause() == 15) &&
+            vmfault(p, r_stval(), r_scause() == 15) == 0){
+    // page fault on demand-paged, mmap()ed or copy-on-write memory
   } else if((which_dev = devintr()) != 0){
     // ok
   } else {
@@ -94,6 +97,9 @@ usertrapret(void)
 {
   struct proc *p = myproc();
 
+  // the kernel is done with the pages uvmprefault() pinned.
+  p->pinstart = p->pinend = 0;
+
   // we're about to switch the destination of traps from
   // kerneltrap() to usertrap(), so turn off interrupts until
   // we're back in user space, where usertrap() is correct.
@@ -105,7 +111,7 @@ usertrapret(void)
   // set up trapframe values that uservec will need when
   // the process next re-enters the kernel.
   p->trapframe->kernel_satp = r_satp();         // kernel page table
-  p->trapframe->kernel_sp = p->kstack + PGSIZE; // process's kernel stack
+  p->trapframe->kernel_sp = p->kstack + KSTACKSIZE; // process's kernel stack
   p->trapframe->kernel_trap = (uint64)usertrap;
   p->trapframe->kernel_hartid = r_tp();         // hartid for cpuid()
 
@@ -121,14 +127,15 @@ usertrapret(void)
   // set S Exception Program Counter to the saved user pc.
   w_sepc(p->trapframe->epc);
 
-  // tell trampoline.S the user page table to switch to.
-  uint64 satp = MAKE_SATP(p->pagetable);
+  // tell trampoline.S the user page table to switch to,
+  // and whether it must flush the TLB on the way.
+  uint64 satp = uvmactivate(p);
 
   // jump to trampoline.S at the top of memory, which 
   // switches to the user page table, restores user registers,
   // and switches to user mode with sret.
   uint64 fn = TRAMPOLINE + (userret - trampoline);
-  ((void (*)(uint64,uint64))fn)(TRAPFRAME, satp);
+  ((void (*)(uint64,uint64,uint64))fn)(TRAPFRAME, satp, p->trapframe->tlbflush);
 }
 
 // interrupts and exceptions from kernel code go here via kernelvec,
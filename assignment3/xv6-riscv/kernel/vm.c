@@ -5,24 +5,98 @@
 #include "riscv.h"
 #include "defs.h"
 #include "fs.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "iovec.h"
+#include "procstat.h"
 
 /*
  * the kernel's page table.
  */
 pagetable_t kernel_pagetable;
 
+// number of megapage mappings in use.
+int nmegapages;
+
+// Free page-table pages, cached per CPU.  freewalk() leaves
+// a page table all zeros, so ptalloc() can hand it out again
+// without the memset kalloc_zeroed() would do, and building
+// or tearing down a process's page table stays off the
+// allocator's locks.
+#define PTCACHE_MAX 16
+
+static struct ptcache {
+  pagetable_t pages[PTCACHE_MAX];
+  int n;
+  uint64 nhit, nmiss;
+} ptcache[NCPU];
+
+// Address-space IDs.  Each user page table is tagged with an
+// ASID in satp (the kernel's is 0), so the TLB needn't be
+// flushed when switching between them.  ASIDs are handed out
+// in generations: when they run out, the generation is bumped,
+// and each hart flushes its whole TLB before it next enters
+// user space, and each process takes a new ASID.  Between
+// generations, a process's own entries are flushed when its
+// page table changes or it moves to another hart.
+static struct {
+  struct spinlock lock;
+  uint64 gen;           // current generation
+  uint next;            // next free ASID in it
+  uint max;             // largest ASID, 0 if the hart has none
+} asids;
+
 extern char etext[];  // kernel.ld sets this to end of kernel code.
 
 extern char trampoline[]; // trampoline.S
 
+static pte_t *walklevel(pagetable_t, uint64, int, int);
+
+// Allocate a zeroed page-table page, or return 0.
+static pagetable_t
+ptalloc(void)
+{
+  struct ptcache *c;
+  pagetable_t pt = 0;
+
+  push_off();
+  c = &ptcache[cpuid()];
+  if(c->n > 0){
+    pt = c->pages[--c->n];
+    c->nhit++;
+  } else {
+    c->nmiss++;
+  }
+  pop_off();
+  if(pt == 0)
+    pt = (pagetable_t)kalloc_zeroed();
+  return pt;
+}
+
+// Free page-table page pt, which must be all zeros.
+static void
+ptfree(pagetable_t pt)
+{
+  struct ptcache *c;
+
+  push_off();
+  c = &ptcache[cpuid()];
+  if(c->n < PTCACHE_MAX){
+    c->pages[c->n++] = pt;
+    pt = 0;
+  }
+  pop_off();
+  if(pt)
+    kfree((void*)pt);
+}
+
 // Make a direct-map page table for the kernel.
 pagetable_t
 kvmmake(void)
 {
   pagetable_t kpgtbl;
 
-  kpgtbl = (pagetable_t) kalloc();
-  memset(kpgtbl, 0, PGSIZE);
+  kpgtbl = (pagetable_t) kalloc_zeroed();
 
   // uart registers
   kvmmap(kpgtbl, UART0, UART0, PGSIZE, PTE_R | PTE_W);
@@ -43,9 +117,6 @@ kvmmake(void)
   // the highest virtual address in the kernel.
   kvmmap(kpgtbl, TRAMPOLINE, (uint64)trampoline, PGSIZE, PTE_R | PTE_X);
 
-  // map kernel stacks
-  proc_mapstacks(kpgtbl);
-  
   return kpgtbl;
 }
 
@@ -54,6 +125,9 @@ void
 kvminit(void)
 {
   kernel_pagetable = kvmmake();
+  initlock(&asids.lock, "asid");
+  asids.gen = 1;
+  asids.next = 1;
 }
 
 // Switch h/w page table register to the kernel's page table,
@@ -61,10 +135,150 @@ kvminit(void)
 void
 kvminithart()
 {
+  // find out how many ASID bits the hardware has by
+  // writing ones to the field and reading back.
+  w_satp(MAKE_SATP(kernel_pagetable) | SATP_ASID(SATP_ASIDMASK));
+  asids.max = (r_satp() >> 44) & SATP_ASIDMASK;
   w_satp(MAKE_SATP(kernel_pagetable));
   sfence_vma();
 }
 
+// Kernel stacks come and go with processes, so a hart may
+// hold TLB entries for a stack that has since been unmapped
+// and its pages reused.  kstackgen counts unmaps, and a hart
+// that hasn't seen the latest flushes before it switches to
+// a process, which may have been given the same stack address.
+static uint64 kstackgen;
+
+// Make the page-table pages for a stack of npages at kernel
+// address va, so that kvmallocstack() need not allocate any:
+// two harts must not add page-table pages at once, and the
+// process table's lock serializes calls to this.
+// Returns 0, or -1 if out of memory.
+int
+kvminitstack(uint64 va, int npages)
+{
+  for(int i = 0; i < npages; i++)
+    if(walk(kernel_pagetable, va + i*PGSIZE, 1) == 0)
+      return -1;
+  return 0;
+}
+
+// Map npages zeroed pages at kernel address va, whose
+// page-table pages must already exist (kvminitstack()).
+// Returns 0, or -1 if out of memory.
+int
+kvmallocstack(uint64 va, int npages)
+{
+  char *mem;
+
+  for(int i = 0; i < npages; i++){
+    if((mem = kalloc_zeroed()) == 0)
+      return -1; // freeproc() unmaps what was mapped
+    if(mappages(kernel_pagetable, va + i*PGSIZE, PGSIZE, (uint64)mem, PTE_R | PTE_W) != 0)
+      panic("kvmallocstack");
+  }
+  return 0;
+}
+
+// Unmap and free a stack mapped by kvmallocstack().
+void
+kvmfreestack(uint64 va, int npages)
+{
+  uvmunmap(kernel_pagetable, va, npages, 1);
+  __sync_fetch_and_add(&kstackgen, 1);
+}
+
+// Flush this hart's TLB if a kernel stack has been unmapped
+// since it last did.  Called by the scheduler, with
+// interrupts off, before switching to a process.
+void
+kvmsync(void)
+{
+  struct cpu *c = mycpu();
+  uint64 gen = kstackgen;
+
+  if(c->kstackgen != gen){
+    c->kstackgen = gen;
+    sfence_vma();
+  }
+}
+
+// Give p's page table a new ASID from the current generation,
+// starting a new generation if they have run out.
+// Caller must hold asids.lock.
+static void
+asidnext(struct proc *p)
+{
+  if(asids.next > asids.max){
+    asids.gen++;
+    asids.next = 1;
+  }
+  p->asid = asids.next++;
+  p->asidgen = asids.gen;
+}
+
+void
+asidalloc(struct proc *p)
+{
+  if(asids.max == 0)
+    return; // no ASIDs: every switch flushes the TLB
+  acquire(&asids.lock);
+  asidnext(p);
+  release(&asids.lock);
+}
+
+// Prepare the TLB for p to run in user space on this hart,
+// and return the satp value for its page table.  Sets
+// p->trapframe->tlbflush if trampoline.S must flush the whole
+// TLB on every switch instead.  Called with interrupts off.
+uint64
+uvmactivate(struct proc *p)
+{
+  struct cpu *c = mycpu();
+  int flushall = 0;
+
+  if(asids.max == 0){
+    p->trapframe->tlbflush = 1;
+    return MAKE_SATP(p->pagetable);
+  }
+  p->trapframe->tlbflush = 0;
+
+  if(p->asidgen != asids.gen || c->asidgen != asids.gen){
+    acquire(&asids.lock);
+    if(p->asidgen != asids.gen)
+      asidnext(p);
+    if(c->asidgen != p->asidgen){
+      // entries left from an older generation may carry
+      // ASIDs that have since been handed out again.
+      flushall = 1;
+      c->asidgen = p->asidgen;
+    }
+    release(&asids.lock);
+  }
+
+  if(flushall)
+    sfence_vma();
+  else if(p->tlbflush || p->tlbcpu != c)
+    sfence_vma_asid(p->asid); // stale entries for p may be here
+  p->tlbflush = 0;
+  p->tlbcpu = c;
+  return MAKE_SATP(p->pagetable) | SATP_ASID(p->asid);
+}
+
+// Note that PTEs of pagetable have changed.  If it is the
+// current process's, uvmactivate() will flush the process's
+// TLB entries before it next runs in user space.  Other page
+// tables are new ones whose ASID has no entries yet.
+static void
+tlbstale(pagetable_t pagetable)
+{
+  struct proc *p = myproc();
+
+  if(p && p->pagetable == pagetable)
+    p->tlbflush = 1;
+}
+
 // Return the address of the PTE in page table pagetable
 // that corresponds to virtual address va.  If alloc!=0,
 // create any required page-table pages.
@@ -77,24 +291,35 @@ kvminithart()
 //   21..29 -- 9 bits of level-1 index.
 //   12..20 -- 9 bits of level-0 index.
 //    0..11 -- 12 bits of byte offset within the page.
+// A level-1 PTE may itself be a leaf, mapping a 2 MB
+// megapage; walk() returns that PTE for any va inside it.
 pte_t *
 walk(pagetable_t pagetable, uint64 va, int alloc)
+{
+  return walklevel(pagetable, va, alloc, 0);
+}
+
+// Like walk(), but return the PTE at the given level
+// (0 for a page, 1 for a megapage).
+static pte_t *
+walklevel(pagetable_t pagetable, uint64 va, int alloc, int leaf)
 {
   if(va >= MAXVA)
     panic("walk");
 
-  for(int level = 2; level > 0; level--) {
+  for(int level = 2; level > leaf; level--) {
     pte_t *pte = &pagetable[PX(level, va)];
     if(*pte & PTE_V) {
+      if(*pte & (PTE_R|PTE_W|PTE_X))
+        return pte; // megapage leaf
       pagetable = (pagetable_t)PTE2PA(*pte);
     } else {
-      if(!alloc || (pagetable = (pde_t*)kalloc()) == 0)
+      if(!alloc || (pagetable = ptalloc()) == 0)
         return 0;
-      memset(pagetable, 0, PGSIZE);
       *pte = PA2PTE(pagetable) | PTE_V;
     }
   }
-  return &pagetable[PX(0, va)];
+  return &pagetable[PX(leaf, va)];
 }
 
 // Look up a virtual address, return the physical address,
@@ -120,14 +345,69 @@ walkaddr(pagetable_t pagetable, uint64 va)
   return pa;
 }
 
-// add a mapping to the kernel page table.
+// add a mapping to the kernel page table, using megapages
+// for the parts where va and pa are both 2 MB aligned.
 // only used when booting.
 // does not flush TLB or enable paging.
 void
 kvmmap(pagetable_t kpgtbl, uint64 va, uint64 pa, uint64 sz, int perm)
 {
-  if(mappages(kpgtbl, va, sz, pa, perm) != 0)
-    panic("kvmmap");
+  uint64 n;
+
+  while(sz > 0){
+    if(va % MEGAPGSIZE == 0 && pa % MEGAPGSIZE == 0 && sz >= MEGAPGSIZE){
+      n = MEGAPGSIZE;
+      if(mapmegapage(kpgtbl, va, pa, perm) != 0)
+        panic("kvmmap");
+    } else {
+      // small pages up to the next megapage boundary.
+      n = MEGAPGSIZE - va % MEGAPGSIZE;
+      if(n > sz)
+        n = sz;
+      if(mappages(kpgtbl, va, n, pa, perm) != 0)
+        panic("kvmmap");
+    }
+    va += n;
+    pa += n;
+    sz -= n;
+  }
+}
+
+// Map the 2 MB megapage at va to pa, both megapage-aligned.
+// Returns 0 on success, -1 if a page-table page couldn't
+// be allocated.
+int
+mapmegapage(pagetable_t pagetable, uint64 va, uint64 pa, int perm)
+{
+  pte_t *pte;
+
+  if(va % MEGAPGSIZE || pa % MEGAPGSIZE)
+    panic("mapmegapage: not aligned");
+  if((pte = walklevel(pagetable, va, 1, 1)) == 0)
+    return -1;
+  if(*pte & PTE_V)
+    panic("mapmegapage: remap");
+  *pte = PA2PTE(pa) | perm | PTE_V;
+  __sync_fetch_and_add(&nmegapages, 1);
+  return 0;
+}
+
+// Print virtual memory counters.  For ^F on the console.
+void
+vmdump(void)
+{
+  struct ptcache *c;
+  uint64 hit = 0, miss = 0;
+  int n = 0;
+
+  printf("megapage mappings: %d\n", nmegapages);
+  for(c = ptcache; c < &ptcache[NCPU]; c++){
+    n += c->n;
+    hit += c->nhit;
+    miss += c->nmiss;
+  }
+  printf("page-table cache: %d pages, %d hits %d misses\n",
+         n, (int)hit, (int)miss);
 }
 
 // Create PTEs for virtual addresses starting at va that refer to
@@ -156,6 +436,7 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
     a += PGSIZE;
     pa += PGSIZE;
   }
+  tlbstale(pagetable);
   return 0;
 }
 
@@ -172,10 +453,14 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
     panic("uvmunmap: not aligned");
 
   for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
+    // user pages below p->sz may never have been touched.
     if((pte = walk(pagetable, a, 0)) == 0)
-      panic("uvmunmap: walk");
-    if((*pte & PTE_V) == 0)
-      panic("uvmunmap: not mapped");
+      continue;
+    if((*pte & PTE_V) == 0){
+      if(*pte & (PTE_SWAP|PTE_EVICT))
+        swapunmap(pte, do_free);
+      continue;
+    }
     if(PTE_FLAGS(*pte) == PTE_V)
       panic("uvmunmap: not a leaf");
     if(do_free){
@@ -184,6 +469,7 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
     }
     *pte = 0;
   }
+  tlbstale(pagetable);
 }
 
 // create an empty user page table.
@@ -192,10 +478,9 @@ pagetable_t
 uvmcreate()
 {
   pagetable_t pagetable;
-  pagetable = (pagetable_t) kalloc();
+  pagetable = ptalloc();
   if(pagetable == 0)
     return 0;
-  memset(pagetable, 0, PGSIZE);
   return pagetable;
 }
 
@@ -209,8 +494,7 @@ uvminit(pagetable_t pagetable, uchar *src, uint sz)
 
   if(sz >= PGSIZE)
     panic("inituvm: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
+  mem = kalloc_zeroed();
   mappages(pagetable, 0, PGSIZE, (uint64)mem, PTE_W|PTE_R|PTE_X|PTE_U);
   memmove(mem, src, sz);
 }
@@ -228,12 +512,11 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 
   oldsz = PGROUNDUP(oldsz);
   for(a = oldsz; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = kalloc_zeroed();
     if(mem == 0){
       uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if(mappages(pagetable, a, PGSIZE, (uint64)mem, PTE_W|PTE_X|PTE_R|PTE_U) != 0){
       kfree(mem);
       uvmdealloc(pagetable, a, oldsz);
@@ -273,12 +556,13 @@ freewalk(pagetable_t pagetable)
       // this PTE points to a lower-level page table.
       uint64 child = PTE2PA(pte);
       freewalk((pagetable_t)child);
-      pagetable[i] = 0;
     } else if(pte & PTE_V){
       panic("freewalk: leaf");
     }
+    if(pte)
+      pagetable[i] = 0; // for ptfree()
   }
-  kfree((void*)pagetable);
+  ptfree(pagetable);
 }
 
 // Free user memory pages,
@@ -291,42 +575,285 @@ uvmfree(pagetable_t pagetable, uint64 sz)
   freewalk(pagetable);
 }
 
+static void
+statwalk(pagetable_t pagetable, int level, uint64 va, struct procstat *st)
+{
+  st->ptpages++;
+  for(int i = 0; i < 512; i++){
+    pte_t pte = pagetable[i];
+    uint64 a = va + ((uint64)i << PXSHIFT(level));
+    if(level > 0 && (pte & PTE_V) && (pte & (PTE_R|PTE_W|PTE_X)) == 0){
+      statwalk((pagetable_t)PTE2PA(pte), level-1, a, st);
+    } else if(pte & (PTE_V|PTE_EVICT)){
+      if((pte & PTE_U) == 0)
+        continue; // trampoline, trapframe, stack guard
+      st->rss++;
+      if(a >= SHMBASE || krefcount((void*)PTE2PA(pte & ~PTE_EVICT)) > 1)
+        st->shared++;
+    } else if(pte & PTE_SWAP){
+      st->swapped++;
+    }
+  }
+}
+
+// Count the pages of user page table pagetable for pinfo():
+// user pages in memory, those that are also mapped elsewhere
+// (program text, copy-on-write and shm pages), pages on swap,
+// and page-table pages.  Found by walking the table rather
+// than kept up to date, since a page stops being shared when
+// the other sharers unmap it, without this table changing.
+void
+uvmstat(pagetable_t pagetable, struct procstat *st)
+{
+  st->rss = st->shared = st->swapped = st->ptpages = 0;
+  if(pagetable)
+    statwalk(pagetable, 2, 0, st);
+}
+
 // Given a parent process's page table, copy
 // its memory into a child's page table.
-// Copies both the page table and the
-// physical memory.
+// The physical pages are shared, not copied: writable
+// pages become read-only and copy-on-write in both page
+// tables, and cowfault() copies them on the first store.
 // returns 0 on success, -1 on failure.
 // frees any allocated pages on failure.
 int
 uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
 {
-  pte_t *pte;
+  return uvmcopyrange(old, new, 0, sz, 0);
+}
+
+// Like uvmcopy(), for the pages of old in [start, end).
+// If shared is set, writable pages stay writable in both
+// page tables, so each sees the other's stores.
+int
+uvmcopyrange(pagetable_t old, pagetable_t new, uint64 start, uint64 end, int shared)
+{
+  pte_t *pte, *npte;
   uint64 pa, i;
   uint flags;
-  char *mem;
 
-  for(i = 0; i < sz; i += PGSIZE){
+  for(i = start; i < end; i += PGSIZE){
     if((pte = walk(old, i, 0)) == 0)
-      panic("uvmcopy: pte should exist");
+      continue; // not yet touched (lazy sbrk)
+    swaprescue(pte);
+    if(*pte & PTE_SWAP){
+      // each reads its own copy back from the shared slot.
+      if((npte = walk(new, i, 1)) == 0)
+        goto err;
+      *npte = swapdup(*pte);
+      continue;
+    }
     if((*pte & PTE_V) == 0)
-      panic("uvmcopy: page not present");
+      continue;
+    if(!shared && (*pte & PTE_W))
+      *pte = (*pte & ~PTE_W) | PTE_COW;
     pa = PTE2PA(*pte);
     flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
+    if(mappages(new, i, PGSIZE, pa, flags) != 0)
       goto err;
-    memmove(mem, (char*)pa, PGSIZE);
-    if(mappages(new, i, PGSIZE, (uint64)mem, flags) != 0){
-      kfree(mem);
-      goto err;
-    }
+    krefinc((void*)pa);
   }
+  tlbstale(old); // old's PTEs lost PTE_W.
   return 0;
 
  err:
-  uvmunmap(new, 0, i / PGSIZE, 1);
+  tlbstale(old);
+  uvmunmap(new, start, (i - start) / PGSIZE, 1);
   return -1;
 }
 
+static uint64 uvmaddr(pagetable_t, uint64, int);
+
+// Handle a page fault by process p at user address va,
+// for a store if write is set: read in a page of the
+// program from its file, allocate a zeroed page for heap
+// that sbrk() reserved but nobody has touched yet, fill in
+// a page of an mmap() region, read back a page that was
+// swapped out, or copy a copy-on-write page.
+// Returns 0 if the access may be retried, -1 if it is bad.
+int
+vmfault(struct proc *p, uint64 va, int write)
+{
+  pte_t *pte;
+  char *mem;
+  int perm, r;
+
+  if(va >= MAXVA)
+    return -1;
+  va = PGROUNDDOWN(va);
+  // each case below may allocate a page.
+  if(mycpu()->noff == 0)
+    swapthrottle();
+  pte = walk(p->pagetable, va, 0);
+  if(pte && (*pte & PTE_V)){
+    if(write && (*pte & PTE_COW))
+      return cowfault(p->pagetable, va);
+    return -1; // e.g. the stack guard page
+  }
+  if(pte && (*pte & (PTE_SWAP|PTE_EVICT)))
+    return swapfault(p, pte);
+
+  if(va >= MMAPBASE && va < SHMBASE){
+    // a file mapping reads the file, as below.
+    if(mycpu()->noff > 0)
+      return -1;
+    return mmapfault(p, va, write);
+  }
+  if(va >= p->sz)
+    return -1;
+
+  if(p->nseg > 0){
+    // reading the program file may sleep, which the
+    // caller can't do while holding a spinlock; see
+    // uvmprefault().
+    if(mycpu()->noff > 0)
+      return -1;
+    if((r = execfault(p, va, &mem, &perm)) < 0)
+      return -1;
+    if(r > 0){
+      // heap
+      if((mem = kalloc_zeroed()) == 0)
+        return -1;
+      perm = PTE_W|PTE_X|PTE_R|PTE_U;
+    }
+  } else {
+    if((mem = kalloc_zeroed()) == 0)
+      return -1;
+    perm = PTE_W|PTE_X|PTE_R|PTE_U;
+  }
+  if(write && (perm & PTE_W) == 0){
+    kfree(mem);
+    return -1;
+  }
+  if(mappages(p->pagetable, va, PGSIZE, (uint64)mem, perm) != 0){
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
+// Fault in the pages of the current process's user range
+// [va, va+len) before the caller takes locks under which a
+// page fault could not sleep (pipe and console locks, and
+// the inode lock of the program file itself).  Failures are
+// left for the later copy to report.  The pages stay out
+// of the reclaimer's reach until the process next returns
+// to user space, since the caller may sleep before copying.
+void
+uvmprefault(uint64 va, uint64 len, int write)
+{
+  struct proc *p = myproc();
+  uint64 a;
+
+  if(len == 0 || va + len < va)
+    return;
+  if(va < p->sz && va + len > p->sz)
+    len = p->sz - va;
+  p->pinstart = PGROUNDDOWN(va);
+  p->pinend = va + len;
+  for(a = PGROUNDDOWN(va); a < va + len; a += PGSIZE)
+    if(uvmaddr(p->pagetable, a, write) == 0)
+      break;
+}
+
+// Physical address of user page va0, for a kernel copy
+// to (write) or from it: fault the page in if it is
+// lazily allocated, swapped out or copy-on-write.  Returns 0 if the
+// address is bad.
+static uint64
+uvmaddr(pagetable_t pagetable, uint64 va0, int write)
+{
+  struct proc *p = myproc();
+  pte_t *pte;
+  uint64 pa;
+
+  if(va0 >= MAXVA)
+    return 0;
+  pa = walkaddr(pagetable, va0);
+  if(pa == 0 && p && p->pagetable == pagetable && vmfault(p, va0, write) == 0)
+    pa = walkaddr(pagetable, va0);
+  pte = walk(pagetable, va0, 0);
+  if(pa && write && (*pte & PTE_COW)){
+    if(cowfault(pagetable, va0) < 0)
+      return 0;
+    pa = PTE2PA(*pte);
+  }
+  // shared program text must not be written, even by the kernel.
+  if(pa && write && (*pte & PTE_W) == 0)
+    return 0;
+  // the hardware sets PTE_D only for user stores.
+  if(pa && write)
+    *pte |= PTE_D;
+  return pa;
+}
+
+// uvmaddr(), and take a reference to the page, which the
+// caller drops with kfree() when done with it.  A process
+// can be preempted in the middle of a copy, and the
+// reclaimer leaves pages with other references alone.
+static uint64
+uvmhold(pagetable_t pagetable, uint64 va0, int write)
+{
+  struct proc *p = myproc();
+  pte_t *pte;
+  uint64 pa;
+
+  for(;;){
+    if((pa = uvmaddr(pagetable, va0, write)) == 0)
+      return 0;
+    if(p == 0 || p->pagetable != pagetable){
+      // not a page table the reclaimer looks at.
+      krefinc((void*)pa);
+      return pa;
+    }
+    // pick() examines PTEs under p->lock.
+    acquire(&p->lock);
+    pte = walk(pagetable, va0, 0);
+    if(pte && (*pte & PTE_V) && PTE2PA(*pte) == pa){
+      krefinc((void*)pa);
+      release(&p->lock);
+      return pa;
+    }
+    release(&p->lock);
+  }
+}
+
+// Handle a store to copy-on-write page va: give the
+// process its own writable copy, or just make the page
+// writable if no one else shares it any more.
+// Returns 0 on success, -1 if va is not a copy-on-write
+// page or memory is exhausted.
+int
+cowfault(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+  uint64 pa;
+  uint flags;
+  char *mem;
+
+  if(va >= MAXVA)
+    return -1;
+  va = PGROUNDDOWN(va);
+  if((pte = walk(pagetable, va, 0)) == 0)
+    return -1;
+  if((*pte & (PTE_V|PTE_U|PTE_COW)) != (PTE_V|PTE_U|PTE_COW))
+    return -1;
+  pa = PTE2PA(*pte);
+  flags = (PTE_FLAGS(*pte) & ~PTE_COW) | PTE_W;
+  if(krefcount((void*)pa) == 1){
+    *pte = PA2PTE(pa) | flags;
+  } else {
+    if((mem = kalloc()) == 0)
+      return -1;
+    memmove(mem, (char*)pa, PGSIZE);
+    *pte = PA2PTE(mem) | flags;
+    kfree((void*)pa);
+  }
+  tlbstale(pagetable);
+  return 0;
+}
+
 // mark a PTE invalid for user access.
 // used by exec for the user stack guard page.
 void
@@ -338,56 +865,122 @@ uvmclear(pagetable_t pagetable, uint64 va)
   if(pte == 0)
     panic("uvmclear");
   *pte &= ~PTE_U;
+  tlbstale(pagetable);
 }
 
 // Copy from kernel to user.
+// Copy the niov spans of iov, in order, to virtual address
+// dstva in a given page table.  Each user page is looked up
+// once however many spans it takes.
+// Return 0 on success, -1 on error.
+int
+copyoutv(pagetable_t pagetable, uint64 dstva, struct iovec *iov, int niov)
+{
+  uint64 n, len, va0 = -1, pa0 = 0;
+  char *src;
+
+  for(; niov > 0; iov++, niov--){
+    src = iov->base;
+    len = iov->len;
+    while(len > 0){
+      if(PGROUNDDOWN(dstva) != va0){
+        if(pa0)
+          kfree((void*)pa0);
+        va0 = PGROUNDDOWN(dstva);
+        if((pa0 = uvmhold(pagetable, va0, 1)) == 0)
+          return -1;
+      }
+      n = PGSIZE - (dstva - va0);
+      if(n > len)
+        n = len;
+      memmove((void *)(pa0 + (dstva - va0)), src, n);
+
+      len -= n;
+      src += n;
+      dstva += n;
+    }
+  }
+  if(pa0)
+    kfree((void*)pa0);
+  return 0;
+}
+
 // Copy len bytes from src to virtual address dstva in a given page table.
 // Return 0 on success, -1 on error.
 int
 copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
-  uint64 n, va0, pa0;
+  struct iovec iov = { src, len };
 
-  while(len > 0){
-    va0 = PGROUNDDOWN(dstva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
-      return -1;
-    n = PGSIZE - (dstva - va0);
-    if(n > len)
-      n = len;
-    memmove((void *)(pa0 + (dstva - va0)), src, n);
-
-    len -= n;
-    src += n;
-    dstva = va0 + PGSIZE;
+  return copyoutv(pagetable, dstva, &iov, 1);
+}
+
+// Copy from user to kernel.
+// Fill the niov spans of iov, in order, from virtual
+// address srcva in a given page table.
+// Return 0 on success, -1 on error.
+int
+copyinv(pagetable_t pagetable, struct iovec *iov, int niov, uint64 srcva)
+{
+  uint64 n, len, va0 = -1, pa0 = 0;
+  char *dst;
+
+  for(; niov > 0; iov++, niov--){
+    dst = iov->base;
+    len = iov->len;
+    while(len > 0){
+      if(PGROUNDDOWN(srcva) != va0){
+        if(pa0)
+          kfree((void*)pa0);
+        va0 = PGROUNDDOWN(srcva);
+        if((pa0 = uvmhold(pagetable, va0, 0)) == 0)
+          return -1;
+      }
+      n = PGSIZE - (srcva - va0);
+      if(n > len)
+        n = len;
+      memmove(dst, (void *)(pa0 + (srcva - va0)), n);
+
+      len -= n;
+      dst += n;
+      srcva += n;
+    }
   }
+  if(pa0)
+    kfree((void*)pa0);
   return 0;
 }
 
-// Copy from user to kernel.
 // Copy len bytes to dst from virtual address srcva in a given page table.
 // Return 0 on success, -1 on error.
 int
 copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 {
-  uint64 n, va0, pa0;
+  struct iovec iov = { dst, len };
 
-  while(len > 0){
-    va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
-      return -1;
-    n = PGSIZE - (srcva - va0);
-    if(n > len)
-      n = len;
-    memmove(dst, (void *)(pa0 + (srcva - va0)), n);
+  return copyinv(pagetable, &iov, 1, srcva);
+}
 
-    len -= n;
-    dst += n;
-    srcva = va0 + PGSIZE;
+// Length of the string s, or max if none of its first max
+// bytes is a '\0'.  Looks at a word at a time once s is
+// aligned; the words read never cross s+max.
+static uint64
+strnlen_word(char *s, uint64 max)
+{
+  uint64 i, w;
+
+  for(i = 0; i < max && ((uint64)(s + i) % sizeof(uint64)) != 0; i++)
+    if(s[i] == '\0')
+      return i;
+  for(; i + sizeof(uint64) <= max; i += sizeof(uint64)){
+    w = *(uint64*)(s + i);
+    if((w - 0x0101010101010101UL) & ~w & 0x8080808080808080UL)
+      break; // a zero byte in this word
   }
-  return 0;
+  for(; i < max; i++)
+    if(s[i] == '\0')
+      return i;
+  return max;
 }
 
 // Copy a null-terminated string from user to kernel.
@@ -397,38 +990,31 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 int
 copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 {
-  uint64 n, va0, pa0;
-  int got_null = 0;
+  uint64 n, len, va0, pa0;
+  char *p;
 
-  while(got_null == 0 && max > 0){
+  while(max > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = uvmhold(pagetable, va0, 0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
     if(n > max)
       n = max;
 
-    char *p = (char *) (pa0 + (srcva - va0));
-    while(n > 0){
-      if(*p == '\0'){
-        *dst = '\0';
-        got_null = 1;
-        break;
-      } else {
-        *dst = *p;
-      }
-      --n;
-      --max;
-      p++;
-      dst++;
+    p = (char *) (pa0 + (srcva - va0));
+    len = strnlen_word(p, n);
+    if(len < n){
+      memmove(dst, p, len + 1);
+      kfree((void*)pa0);
+      return 0;
     }
+    memmove(dst, p, n);
+    kfree((void*)pa0);
 
+    max -= n;
+    dst += n;
     srcva = va0 + PGSIZE;
   }
-  if(got_null){
-    return 0;
-  } else {
-    return -1;
-  }
+  return -1;
 }
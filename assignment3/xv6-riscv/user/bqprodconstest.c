@@ -0,0 +1,81 @@
+#include "kernel/types.h"
+#include "kernel/bqueue.h"
+#include "user/user.h"
+
+#define BATCH 64
+
+int num_items, num_prods, num_cons;
+
+int produce (int index, int tid)
+{
+   return index+(num_items*tid);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, j, n, q, got;
+  int items[BATCH];
+  int sum, expected;
+
+  if (argc != 4) {
+     fprintf(2, "syntax: bqprodconstest number of items to be produced by each producer, number of producers, number of consumers.\nAborting...\n");
+     exit(0);
+  }
+
+  num_items = atoi(argv[1]);
+  num_prods = atoi(argv[2]);
+  num_cons = atoi(argv[3]);
+  if ((q = bqueue_alloc(BQ_MAXCAP)) < 0) {
+     fprintf(2, "Error: cannot allocate queue\nAborting...\n");
+     exit(0);
+  }
+
+  printf("Start time: %d\n\n", uptime());
+  for (i=0; i<num_prods; i++) {
+     if (fork() == 0) {
+        for (j=0; j<num_items; j+=n) {
+           n = (num_items-j < BATCH) ? num_items-j : BATCH;
+           for (got=0; got<n; got++) items[got] = produce(j+got, i);
+           if (produce_many(q, items, n, 0) != n) {
+              fprintf(2, "Error: produce_many failed\n");
+              exit(1);
+           }
+        }
+        exit(0);
+     }
+  }
+  // Each consumer reports the sum of what it consumed as its exit status.
+  for (i=0; i<num_cons; i++) {
+     if (fork() == 0) {
+        sum = 0;
+        for (j=0; j<(num_items*num_prods)/num_cons; j+=got) {
+           n = (num_items*num_prods)/num_cons - j;
+           if (n > BATCH) n = BATCH;
+           if ((got = consume_many(q, items, n, 0)) <= 0) {
+              fprintf(2, "Error: consume_many failed\n");
+              exit(-1);
+           }
+           for (n=0; n<got; n++) sum += items[n];
+        }
+        exit(sum);
+     }
+  }
+  for (i=0; i<num_prods; i++) wait(0);
+  sum = 0;
+  for (i=0; i<num_cons; i++) {
+     wait(&got);
+     sum += got;
+  }
+  printf("End time: %d\n", uptime());
+
+  // Items left over when num_cons does not divide the total.
+  while ((got = consume_many(q, items, BATCH, BQ_NONBLOCK)) > 0)
+     for (n=0; n<got; n++) sum += items[n];
+
+  expected = 0;
+  for (i=0; i<num_prods*num_items; i++) expected += i;
+  printf("Sum consumed: %d, expected: %d\n", sum, expected);
+  bqueue_free(q);
+  exit(0);
+}
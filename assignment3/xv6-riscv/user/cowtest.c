@@ -0,0 +1,94 @@
+// Test copy-on-write fork: children write to a large
+// heap shared with their parent, and neither side may see
+// the other's stores.  Also checks that fork of a big
+// process succeeds when there is not enough memory to copy
+// it several times over.
+
+#include "kernel/types.h"
+#include "kernel/riscv.h"
+#include "kernel/memlayout.h"
+#include "user/user.h"
+
+#define NCHILD 4
+
+int
+main(int argc, char *argv[])
+{
+  int i, j, pid, npages, xstatus;
+  char *mem, *pipebuf;
+  int fds[2];
+
+  // a third of physical memory: copying it for each of
+  // NCHILD children would not fit.
+  npages = (PHYSTOP - KERNBASE) / PGSIZE / 3;
+  if((mem = sbrk(npages * PGSIZE)) == (char*)-1){
+    fprintf(2, "cowtest: sbrk failed\n");
+    exit(1);
+  }
+  for(i = 0; i < npages; i++)
+    mem[i*PGSIZE] = i;
+
+  printf("Start time: %d\n", uptime());
+  for(j = 0; j < NCHILD; j++){
+    if((pid = fork()) < 0){
+      fprintf(2, "cowtest: fork %d failed\n", j);
+      exit(1);
+    }
+    if(pid == 0){
+      for(i = 0; i < npages; i++){
+        if(mem[i*PGSIZE] != (char)i){
+          fprintf(2, "cowtest: child %d read wrong value\n", j);
+          exit(1);
+        }
+      }
+      // write every 8th page; the rest stay shared.
+      for(i = 0; i < npages; i += 8)
+        mem[i*PGSIZE] = j + 100;
+      for(i = 0; i < npages; i += 8){
+        if(mem[i*PGSIZE] != (char)(j + 100)){
+          fprintf(2, "cowtest: child %d lost its write\n", j);
+          exit(1);
+        }
+      }
+      exit(0);
+    }
+  }
+  for(j = 0; j < NCHILD; j++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(1);
+  }
+  for(i = 0; i < npages; i++){
+    if(mem[i*PGSIZE] != (char)i){
+      fprintf(2, "cowtest: parent saw a child's write\n");
+      exit(1);
+    }
+  }
+
+  // the kernel writing a shared page (read() into it)
+  // must copy it too.
+  pipebuf = mem + PGSIZE;
+  if(pipe(fds) < 0){
+    fprintf(2, "cowtest: pipe failed\n");
+    exit(1);
+  }
+  if((pid = fork()) == 0){
+    close(fds[1]);
+    if(read(fds[0], pipebuf, 1) != 1 || pipebuf[0] != 'x'){
+      fprintf(2, "cowtest: child read failed\n");
+      exit(1);
+    }
+    exit(0);
+  }
+  close(fds[0]);
+  write(fds[1], "x", 1);
+  close(fds[1]);
+  wait(&xstatus);
+  if(xstatus != 0 || pipebuf[0] != 1){
+    fprintf(2, "cowtest: read into a shared page leaked\n");
+    exit(1);
+  }
+  printf("End time: %d\n", uptime());
+  printf("cowtest: ok\n");
+  exit(0);
+}
@@ -0,0 +1,62 @@
+// Test demand-paged exec: initialised data and bss must read
+// correctly when first touched, a large bss that is never
+// touched must not cost memory, and program text must be
+// read-only.
+
+#include "kernel/types.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+int data[PGSIZE] = { 1, 2, 3 };
+char bss[256*PGSIZE];
+
+int
+main(int argc, char *argv[])
+{
+  int pid, xstatus;
+
+  if(data[0] != 1 || data[2] != 3 || data[PGSIZE-1] != 0){
+    fprintf(2, "demandtest: wrong initialised data\n");
+    exit(1);
+  }
+  if(bss[0] != 0 || bss[sizeof(bss)-1] != 0){
+    fprintf(2, "demandtest: bss not zero\n");
+    exit(1);
+  }
+  bss[100*PGSIZE] = 7;
+  data[1] = 5;
+
+  // the child sees the parent's writes, not the file's contents.
+  if((pid = fork()) < 0){
+    fprintf(2, "demandtest: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    if(bss[100*PGSIZE] != 7 || data[1] != 5 || data[PGSIZE/2] != 0)
+      exit(1);
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    fprintf(2, "demandtest: child saw wrong data\n");
+    exit(1);
+  }
+
+  // a store into text must kill the process.
+  if((pid = fork()) < 0){
+    fprintf(2, "demandtest: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    *(volatile int*)main = 0;
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != -1){
+    fprintf(2, "demandtest: write to text was not fatal\n");
+    exit(1);
+  }
+
+  printf("demandtest: OK\n");
+  exit(0);
+}
@@ -0,0 +1,21 @@
+// free: print how many pages of memory and swap are in use.
+
+#include "kernel/types.h"
+#include "kernel/procstat.h"
+#include "user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  struct meminfo mi;
+
+  if(meminfo(&mi) < 0){
+    fprintf(2, "free: meminfo failed\n");
+    exit(1);
+  }
+  printf("mem: %d pages, %d used, %d free\n",
+         mi.total, mi.total - mi.free, mi.free);
+  printf("swap: %d pages, %d used, %d free\n",
+         mi.swap, mi.swap - mi.swapfree, mi.swapfree);
+  exit(0);
+}
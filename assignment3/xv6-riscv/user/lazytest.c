@@ -0,0 +1,105 @@
+// Test lazy sbrk(): reserving a heap much bigger than
+// physical memory must succeed, touching scattered pages of
+// it must work, and the kernel must fault pages in when a
+// system call reads or writes untouched heap.
+
+#include "kernel/types.h"
+#include "kernel/riscv.h"
+#include "kernel/memlayout.h"
+#include "user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  char *heap, *p;
+  uint64 big, i;
+  int fds[2], pid, xstatus;
+
+  // twice physical memory: only possible if sbrk is lazy.
+  big = 2 * (PHYSTOP - KERNBASE);
+  printf("Start time: %d\n", uptime());
+  if((heap = sbrk(big)) == (char*)-1){
+    fprintf(2, "lazytest: sbrk of %d bytes failed\n", (int)big);
+    exit(1);
+  }
+  for(i = 0; i < big; i += 64*PGSIZE)
+    heap[i] = i / PGSIZE;
+  for(i = 0; i < big; i += 64*PGSIZE){
+    if(heap[i] != (char)(i / PGSIZE)){
+      fprintf(2, "lazytest: wrong value at offset %d\n", (int)i);
+      exit(1);
+    }
+  }
+  // untouched heap reads as zero.
+  if(heap[PGSIZE + 1] != 0){
+    fprintf(2, "lazytest: untouched page not zero\n");
+    exit(1);
+  }
+
+  // the kernel writes (read) and reads (write) untouched pages.
+  p = heap + 3*PGSIZE - 2;
+  if(pipe(fds) < 0){
+    fprintf(2, "lazytest: pipe failed\n");
+    exit(1);
+  }
+  if(write(fds[1], heap + 5*PGSIZE, 4) != 4 || read(fds[0], p, 4) != 4){
+    fprintf(2, "lazytest: system call on lazy page failed\n");
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  if(p[0] != 0 || p[3] != 0){
+    fprintf(2, "lazytest: wrong data read into lazy page\n");
+    exit(1);
+  }
+
+  // fork copies only the touched pages.
+  if((pid = fork()) < 0){
+    fprintf(2, "lazytest: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    heap[big - 1] = 1;
+    exit(heap[64*PGSIZE] == 64 ? 0 : 1);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    fprintf(2, "lazytest: child failed\n");
+    exit(1);
+  }
+
+  // the heap can grow past 4GB, a page touched there is
+  // freed at exit, and it can't shrink below nothing.
+  if((pid = fork()) == 0){
+    for(i = 0; i < 5; i++)
+      if((p = sbrk(1 << 30)) == (char*)-1)
+        exit(1);
+    p[0] = 1;
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    fprintf(2, "lazytest: heap past 4GB failed\n");
+    exit(1);
+  }
+  if(sbrk(-(int)(uint64)sbrk(0) - PGSIZE) != (char*)-1){
+    fprintf(2, "lazytest: heap shrank below zero\n");
+    exit(1);
+  }
+
+  // a touch past the end of the heap is fatal.
+  if((pid = fork()) == 0){
+    heap[big + PGSIZE] = 1;
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != -1){
+    fprintf(2, "lazytest: store past sbrk not killed\n");
+    exit(1);
+  }
+
+  sbrk(-big);
+  printf("End time: %d\n", uptime());
+  printf("lazytest: ok\n");
+  exit(0);
+}
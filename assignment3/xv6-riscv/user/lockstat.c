@@ -0,0 +1,87 @@
+// lockstat [-a|-c|-w|-h] [n]: print the n most contended
+// locks, sorted by acquisitions, contended acquisitions,
+// total wait time (the default), or longest hold.
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/lockstat.h"
+#include "user/user.h"
+
+static struct lockstat st[NLOCKSTAT];
+
+// printf's %l truncates to 32 bits, so print uint64s by hand.
+static void
+putu64(uint64 x, int width)
+{
+  char buf[24];
+  int i = sizeof(buf) - 1;
+
+  buf[i] = 0;
+  do {
+    buf[--i] = '0' + x % 10;
+    x /= 10;
+  } while(x != 0);
+  while(sizeof(buf) - 1 - i < width && i > 0)
+    buf[--i] = ' ';
+  printf("%s", &buf[i]);
+}
+
+static uint64
+key(struct lockstat *s, char by)
+{
+  switch(by){
+  case 'a': return s->nacquire;
+  case 'c': return s->ncontended;
+  case 'h': return s->maxhold;
+  default:  return s->waitcycles;
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct lockstat t;
+  char by = 'w';
+  int i, j, n, max = NLOCKSTAT;
+
+  for(i = 1; i < argc; i++){
+    if(argv[i][0] == '-' && argv[i][1] && strchr("acwh", argv[i][1]))
+      by = argv[i][1];
+    else if(argv[i][0] >= '0' && argv[i][0] <= '9')
+      max = atoi(argv[i]);
+    else {
+      fprintf(2, "usage: lockstat [-a|-c|-w|-h] [n]\n");
+      exit(1);
+    }
+  }
+
+  if((n = lockstat(st, NLOCKSTAT)) < 0){
+    fprintf(2, "lockstat: failed\n");
+    exit(1);
+  }
+
+  // insertion sort, largest first.
+  for(i = 1; i < n; i++){
+    t = st[i];
+    for(j = i; j > 0 && key(&st[j-1], by) < key(&t, by); j--)
+      st[j] = st[j-1];
+    st[j] = t;
+  }
+
+  printf("name              type   acquires  contended       spins        wait     maxhold\n");
+  for(i = 0; i < n && i < max; i++){
+    if(st[i].nacquire == 0)
+      continue;
+    printf("%s", st[i].name);
+    for(j = strlen(st[i].name); j < 18; j++)
+      printf(" ");
+    printf("%s", st[i].type == LOCK_SLEEP ? "sleep" : "spin ");
+    putu64(st[i].nacquire, 11);
+    putu64(st[i].ncontended, 11);
+    putu64(st[i].nspin, 12);
+    putu64(st[i].waitcycles, 12);
+    putu64(st[i].maxhold, 12);
+    printf("\n");
+  }
+  exit(0);
+}
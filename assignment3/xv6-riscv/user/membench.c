@@ -0,0 +1,76 @@
+// Measure memset, memmove and memcmp for a range of sizes.
+// Prints the throughput of each in bytes per 100 ticks of
+// the time CSR, which user code may read (see start.c).
+// "mis" rows copy between buffers whose addresses differ by
+// 1 mod 8, so they can't be done a word at a time.
+
+#include "kernel/types.h"
+#include "user/user.h"
+
+#define BUFSIZE (64*1024)
+#define TOTAL   (4*1024*1024)   // bytes moved per measurement
+
+static char src[BUFSIZE + 64], dst[BUFSIZE + 64];
+
+static uint64
+rdtime(void)
+{
+  uint64 x;
+  asm volatile("rdtime %0" : "=r" (x));
+  return x;
+}
+
+enum { SET, MOVE, MOVEMIS, CMP };
+static char *names[] = { "memset", "memmove", "memmove mis", "memcmp" };
+
+static uint64
+measure(int op, int size)
+{
+  int i, n = TOTAL / size;
+  uint64 t0, t;
+
+  t0 = rdtime();
+  for(i = 0; i < n; i++){
+    switch(op){
+    case SET:
+      memset(dst, i, size);
+      break;
+    case MOVE:
+      memmove(dst, src, size);
+      break;
+    case MOVEMIS:
+      memmove(dst + 1, src, size);
+      break;
+    case CMP:
+      if(memcmp(dst, src, size) != 0)
+        exit(1);
+      break;
+    }
+  }
+  t = rdtime() - t0;
+  return t ? (uint64)n * size * 100 / t : 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  static int sizes[] = { 8, 64, 512, 4096, BUFSIZE };
+  int op, s;
+
+  memset(src, 'x', sizeof(src));
+  printf("bytes per 100 time ticks:\nop          ");
+  for(s = 0; s < sizeof(sizes)/sizeof(sizes[0]); s++)
+    printf(" %d", sizes[s]);
+  printf("\n");
+  for(op = SET; op <= CMP; op++){
+    if(op == CMP)
+      memmove(dst, src, sizeof(dst));
+    printf("%s", names[op]);
+    for(s = strlen(names[op]); s < 12; s++)
+      printf(" ");
+    for(s = 0; s < sizeof(sizes)/sizeof(sizes[0]); s++)
+      printf(" %d", (int)measure(op, sizes[s]));
+    printf("\n");
+  }
+  exit(0);
+}
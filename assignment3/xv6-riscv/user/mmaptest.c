@@ -0,0 +1,154 @@
+// Test mmap()/munmap(): file mappings read the file,
+// MAP_SHARED stores reach the file but pages only read are
+// not written back, MAP_PRIVATE stores do not reach it,
+// anonymous MAP_SHARED memory is shared with a forked
+// child, even pages first touched after the fork, and an
+// unmapped region can no longer be touched.
+
+#include "kernel/types.h"
+#include "kernel/riscv.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define FSIZE (2*PGSIZE + 100)
+
+char buf[FSIZE];
+
+void
+fail(char *msg)
+{
+  fprintf(2, "mmaptest: %s\n", msg);
+  exit(1);
+}
+
+// create the test file, filled with i%251 at offset i.
+void
+makefile(void)
+{
+  int fd, i;
+
+  for(i = 0; i < FSIZE; i++)
+    buf[i] = i % 251;
+  unlink("mmaptest.tmp");
+  if((fd = open("mmaptest.tmp", O_CREATE|O_RDWR)) < 0)
+    fail("create failed");
+  if(write(fd, buf, FSIZE) != FSIZE)
+    fail("write failed");
+  close(fd);
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *p;
+  int fd, i, pid, xstatus;
+
+  makefile();
+
+  // read a file through a private mapping; stores stay private.
+  if((fd = open("mmaptest.tmp", O_RDONLY)) < 0)
+    fail("open failed");
+  p = mmap(0, FSIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(p == (char*)-1)
+    fail("private mmap failed");
+  for(i = 0; i < FSIZE; i++)
+    if(p[i] != (char)(i % 251))
+      fail("wrong data in private mapping");
+  if(p[FSIZE] != 0 || p[3*PGSIZE-1] != 0)
+    fail("past end of file not zero");
+  p[0] = 'x';
+  if(munmap(p, 3*PGSIZE) < 0)
+    fail("munmap failed");
+  // a MAP_SHARED writable mapping of a read-only fd is refused.
+  if(mmap(0, PGSIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0) != (char*)-1)
+    fail("shared writable mapping of read-only file allowed");
+  close(fd);
+
+  // MAP_SHARED stores are written back to the file.
+  if((fd = open("mmaptest.tmp", O_RDWR)) < 0)
+    fail("open failed");
+  p = mmap(0, FSIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, PGSIZE);
+  if(p == (char*)-1)
+    fail("shared mmap failed");
+  if(p[0] != (char)(PGSIZE % 251))
+    fail("mapping at offset has wrong data");
+  p[0] = 'y';
+  p[FSIZE - PGSIZE - 1] = 'z';
+  close(fd);
+  if(munmap(p, FSIZE - PGSIZE) < 0)
+    fail("munmap failed");
+  if((fd = open("mmaptest.tmp", O_RDONLY)) < 0)
+    fail("open failed");
+  if(read(fd, buf, sizeof(buf)) != FSIZE)
+    fail("file changed size");
+  close(fd);
+  if(buf[0] != 0 || buf[PGSIZE] != 'y' || buf[FSIZE-1] != 'z')
+    fail("shared stores not written back");
+
+  // pages that were only read are not written back over
+  // the file's newer contents.
+  if((fd = open("mmaptest.tmp", O_RDWR)) < 0)
+    fail("open failed");
+  p = mmap(0, PGSIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p == (char*)-1)
+    fail("shared mmap failed");
+  if(p[1] != (char)1)
+    fail("wrong data in shared mapping");
+  if(write(fd, "w", 1) != 1)
+    fail("write failed");
+  if(munmap(p, PGSIZE) < 0)
+    fail("munmap failed");
+  close(fd);
+  if((fd = open("mmaptest.tmp", O_RDONLY)) < 0 || read(fd, buf, 1) != 1)
+    fail("reopen failed");
+  close(fd);
+  if(buf[0] != 'w')
+    fail("clean page written back");
+
+  // anonymous shared memory is shared with a child.
+  p = mmap(0, PGSIZE, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+  if(p == (char*)-1)
+    fail("anonymous mmap failed");
+  p[0] = 1;
+  if((pid = fork()) < 0)
+    fail("fork failed");
+  if(pid == 0){
+    p[0] = 2;
+    exit(0);
+  }
+  wait(0);
+  if(p[0] != 2)
+    fail("child's store not seen");
+  // including pages neither process touched before the fork.
+  if(munmap(p, PGSIZE) < 0)
+    fail("munmap failed");
+  p = mmap(0, 2*PGSIZE, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+  if(p == (char*)-1)
+    fail("anonymous mmap failed");
+  if((pid = fork()) < 0)
+    fail("fork failed");
+  if(pid == 0){
+    p[PGSIZE] = 4;
+    exit(0);
+  }
+  wait(0);
+  if(p[PGSIZE] != 4)
+    fail("child's store to untouched page not seen");
+
+  // touching an unmapped region is fatal.
+  if(munmap(p, PGSIZE) < 0)
+    fail("munmap failed");
+  if((pid = fork()) < 0)
+    fail("fork failed");
+  if(pid == 0){
+    p[0] = 3;
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != -1)
+    fail("store to unmapped region not fatal");
+
+  unlink("mmaptest.tmp");
+  printf("mmaptest: OK\n");
+  exit(0);
+}
@@ -0,0 +1,115 @@
+// Test the process table: more processes than the old fixed
+// table held, found by pid for pinfo(), kill() and waitpid(),
+// and orphans, live or exited, passed to init.
+
+#include "kernel/types.h"
+#include "kernel/procstat.h"
+#include "user/user.h"
+
+#define NCHILD 200
+
+int pids[NCHILD];
+
+// fork a child that waits until the write end of fds is closed.
+int
+blocker(int *fds)
+{
+  int pid;
+  char c;
+
+  if((pid = fork()) == 0){
+    close(fds[1]);
+    read(fds[0], &c, 1);
+    exit(0);
+  }
+  return pid;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct procstat st;
+  int fds[2], gfds[2], i, n, pid, gpid;
+
+  if(pipe(fds) < 0){
+    fprintf(2, "proctest: pipe failed\n");
+    exit(1);
+  }
+  for(i = 0; i < NCHILD; i++){
+    if((pids[i] = blocker(fds)) < 0){
+      fprintf(2, "proctest: fork %d failed\n", i);
+      exit(1);
+    }
+  }
+
+  for(i = 0; i < NCHILD; i++){
+    if(pinfo(pids[i], &st) < 0 || st.pid != pids[i] || st.ppid != getpid()){
+      fprintf(2, "proctest: pinfo(%d) wrong\n", pids[i]);
+      exit(1);
+    }
+  }
+  if(waitpid(1, 0) != -1){
+    fprintf(2, "proctest: waitpid on init succeeded\n");
+    exit(1);
+  }
+  pid = pids[NCHILD/2];
+  if(kill(pid) < 0 || waitpid(pid, 0) != pid){
+    fprintf(2, "proctest: kill/waitpid(%d) failed\n", pid);
+    exit(1);
+  }
+  if(pinfo(pid, &st) != -1 || kill(pid) != -1){
+    fprintf(2, "proctest: reaped %d still found\n", pid);
+    exit(1);
+  }
+
+  // an orphaned grandchild belongs to init.
+  if(pipe(gfds) < 0){
+    fprintf(2, "proctest: pipe failed\n");
+    exit(1);
+  }
+  if((pid = fork()) == 0){
+    gpid = blocker(fds);
+    write(gfds[1], &gpid, sizeof(gpid));
+    exit(0);
+  }
+  if(read(gfds[0], &gpid, sizeof(gpid)) != sizeof(gpid) || gpid < 0 ||
+     waitpid(pid, 0) != pid){
+    fprintf(2, "proctest: grandchild failed\n");
+    exit(1);
+  }
+  if(pinfo(gpid, &st) < 0 || st.ppid != 1){
+    fprintf(2, "proctest: orphan %d has parent %d\n", gpid, st.ppid);
+    exit(1);
+  }
+
+  // so does one that has already exited, and init reaps it.
+  if((pid = fork()) == 0){
+    if((gpid = fork()) == 0)
+      exit(0);
+    write(gfds[1], &gpid, sizeof(gpid));
+    sleep(5);
+    exit(0);
+  }
+  if(read(gfds[0], &gpid, sizeof(gpid)) != sizeof(gpid) || gpid < 0 ||
+     waitpid(pid, 0) != pid){
+    fprintf(2, "proctest: grandchild failed\n");
+    exit(1);
+  }
+  for(i = 0; i < 100 && pinfo(gpid, &st) == 0; i++)
+    sleep(1);
+  if(i == 100){
+    fprintf(2, "proctest: zombie orphan %d not reaped\n", gpid);
+    exit(1);
+  }
+
+  close(fds[1]);
+  for(n = 0; wait(0) >= 0; n++)
+    ;
+  if(n != NCHILD - 1){
+    fprintf(2, "proctest: reaped %d children, not %d\n", n, NCHILD - 1);
+    exit(1);
+  }
+
+  printf("proctest: OK\n");
+  exit(0);
+}
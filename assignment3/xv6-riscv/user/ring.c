@@ -0,0 +1,163 @@
+// Lock-free ring buffers; see ring.h.
+//
+// The SPSC ring is the classic head/tail pair: only the producer
+// writes tail and only the consumer writes head.  The MPMC ring
+// gives each slot a sequence number (Vyukov's bounded queue):
+// a slot is free for position pos when seq == pos, and holds the
+// item for pos when seq == pos+1; producers and consumers claim
+// positions with compare-and-swap on tail and head.
+//
+// Blocking uses a waiter count plus an event counter per side.
+// A sleeper bumps the waiter count, retries once, then
+// futex_wait()s on the event counter; the other side, after
+// each successful operation, wakes sleepers only if the waiter
+// count is non-zero.  Both sides issue a full fence between
+// their ring update and reading the other's counter, so either
+// the retry succeeds or the wakeup is sent.
+
+#include "kernel/types.h"
+#include "user/user.h"
+#include "user/ring.h"
+
+#define LOAD(x) (*(volatile typeof(x)*)&(x))
+
+// Initialise a ring of nslots slots in r, which must have
+// RING_BYTES(nslots) bytes.  nslots must be a power of two.
+int
+ring_init(struct ring *r, uint nslots, int mode)
+{
+  uint i;
+
+  if(nslots == 0 || (nslots & (nslots-1)) != 0)
+    return -1;
+  if(mode != RING_SPSC && mode != RING_MPMC)
+    return -1;
+  memset(r, 0, RING_BYTES(nslots));
+  r->mode = mode;
+  r->mask = nslots - 1;
+  for(i = 0; i < nslots; i++)
+    r->slot[i].seq = i;
+  __sync_synchronize();
+  return 0;
+}
+
+// wake processes sleeping on *events if *waiters says there are any.
+static void
+ring_wake(int *waiters, int *events)
+{
+  __sync_synchronize();
+  if(LOAD(*waiters) > 0){
+    __sync_fetch_and_add(events, 1);
+    futex_wake(events);
+  }
+}
+
+// Append v.  Returns 0, or -1 if the ring is full.
+int
+ring_tryput(struct ring *r, int v)
+{
+  struct ring_slot *s;
+  uint pos, seq;
+
+  if(r->mode == RING_SPSC){
+    pos = r->tail;
+    if(pos - LOAD(r->head) > r->mask)
+      return -1;
+    r->slot[pos & r->mask].val = v;
+    __sync_synchronize();
+    LOAD(r->tail) = pos + 1;
+  } else {
+    for(;;){
+      pos = LOAD(r->tail);
+      s = &r->slot[pos & r->mask];
+      seq = LOAD(s->seq);
+      __sync_synchronize();
+      if(seq == pos){
+        if(__sync_bool_compare_and_swap(&r->tail, pos, pos + 1))
+          break;
+      } else if((int)(seq - pos) < 0){
+        return -1;
+      }
+    }
+    s->val = v;
+    __sync_synchronize();
+    LOAD(s->seq) = pos + 1;
+  }
+  ring_wake(&r->getwaiters, &r->getevents);
+  return 0;
+}
+
+// Remove the oldest item into *v.  Returns 0, or -1 if the
+// ring is empty.
+int
+ring_tryget(struct ring *r, int *v)
+{
+  struct ring_slot *s;
+  uint pos, seq;
+
+  if(r->mode == RING_SPSC){
+    pos = r->head;
+    if(pos == LOAD(r->tail))
+      return -1;
+    __sync_synchronize();
+    *v = r->slot[pos & r->mask].val;
+    __sync_synchronize();
+    LOAD(r->head) = pos + 1;
+  } else {
+    for(;;){
+      pos = LOAD(r->head);
+      s = &r->slot[pos & r->mask];
+      seq = LOAD(s->seq);
+      __sync_synchronize();
+      if(seq == pos + 1){
+        if(__sync_bool_compare_and_swap(&r->head, pos, pos + 1))
+          break;
+      } else if((int)(seq - (pos + 1)) < 0){
+        return -1;
+      }
+    }
+    *v = s->val;
+    __sync_synchronize();
+    LOAD(s->seq) = pos + r->mask + 1;
+  }
+  ring_wake(&r->putwaiters, &r->putevents);
+  return 0;
+}
+
+// Append v, sleeping while the ring is full.
+void
+ring_put(struct ring *r, int v)
+{
+  int ev;
+
+  while(ring_tryput(r, v) < 0){
+    ev = LOAD(r->putevents);
+    __sync_fetch_and_add(&r->putwaiters, 1);
+    if(ring_tryput(r, v) == 0){
+      __sync_fetch_and_sub(&r->putwaiters, 1);
+      return;
+    }
+    futex_wait(&r->putevents, ev);
+    __sync_fetch_and_sub(&r->putwaiters, 1);
+  }
+}
+
+// Remove and return the oldest item, sleeping while the
+// ring is empty.
+int
+ring_get(struct ring *r)
+{
+  int v, ev;
+
+  while(ring_tryget(r, &v) < 0){
+    ev = LOAD(r->getevents);
+    __sync_fetch_and_add(&r->getwaiters, 1);
+    if(ring_tryget(r, &v) == 0){
+      __sync_fetch_and_sub(&r->getwaiters, 1);
+      return v;
+    }
+    futex_wait(&r->getevents, ev);
+    __sync_fetch_and_sub(&r->getwaiters, 1);
+  }
+  return v;
+}
@@ -0,0 +1,40 @@
+// Lock-free ring buffers of ints for use in shared memory.
+//
+// A ring lives entirely inside the memory passed to ring_init(),
+// normally a segment from shmget()/shmat(), so processes that
+// attach the segment can exchange items without system calls.
+// ring_put()/ring_get() only enter the kernel, through
+// futex_wait()/futex_wake(), when the ring is full or empty and
+// somebody has to sleep.
+
+#define RING_SPSC 0   // one producer, one consumer
+#define RING_MPMC 1   // many producers, many consumers
+
+struct ring_slot {
+  uint seq;           // MPMC: which lap of the ring the slot is on
+  int val;
+};
+
+struct ring {
+  uint mode;          // RING_SPSC or RING_MPMC
+  uint mask;          // number of slots - 1
+  char pad0[56];
+  uint head;          // next position to consume
+  char pad1[60];
+  uint tail;          // next position to produce
+  char pad2[60];
+  int getwaiters;     // processes sleeping in ring_get()
+  int getevents;      // futex word, bumped to wake them
+  int putwaiters;     // processes sleeping in ring_put()
+  int putevents;      // futex word, bumped to wake them
+  struct ring_slot slot[];
+};
+
+// bytes needed for a ring of nslots slots.
+#define RING_BYTES(nslots) (sizeof(struct ring) + (nslots)*sizeof(struct ring_slot))
+
+int ring_init(struct ring*, uint, int);
+int ring_tryput(struct ring*, int);
+int ring_tryget(struct ring*, int*);
+void ring_put(struct ring*, int);
+int ring_get(struct ring*);
@@ -0,0 +1,71 @@
+#include "kernel/types.h"
+#include "user/user.h"
+#include "user/ring.h"
+
+#define NSLOTS 1024
+
+int num_items, num_prods, num_cons;
+
+int produce (int index, int tid)
+{
+   return index+(num_items*tid);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, j, id, sum, expected, x;
+  int *cons;
+  struct ring *r;
+
+  if (argc != 4) {
+     fprintf(2, "syntax: ringprodconstest number of items to be produced by each producer, number of producers, number of consumers.\nAborting...\n");
+     exit(0);
+  }
+
+  num_items = atoi(argv[1]);
+  num_prods = atoi(argv[2]);
+  num_cons = atoi(argv[3]);
+  if (((id = shmget(0, RING_BYTES(NSLOTS))) < 0) || ((r = (struct ring*)shmat(id)) == (struct ring*)-1)) {
+     fprintf(2, "Error: cannot attach shared memory\nAborting...\n");
+     exit(0);
+  }
+  if ((cons = malloc(num_cons * sizeof(int))) == 0) {
+     fprintf(2, "Error: out of memory\nAborting...\n");
+     exit(0);
+  }
+  ring_init(r, NSLOTS, ((num_prods == 1) && (num_cons == 1)) ? RING_SPSC : RING_MPMC);
+
+  printf("Start time: %d\n\n", uptime());
+  for (i=0; i<num_prods; i++) {
+     if (fork() == 0) {
+	for (j=0; j<num_items; j++) ring_put(r, produce(j, i));
+	exit(0);
+     }
+  }
+  // Each consumer reports the sum of what it consumed as its exit status.
+  for (i=0; i<num_cons; i++) {
+     if ((cons[i] = fork()) == 0) {
+        sum = 0;
+        for (j=0; j<(num_items*num_prods)/num_cons; j++) sum += ring_get(r);
+        exit(sum);
+     }
+  }
+  // Reap the consumers by pid, so a producer's status is never summed.
+  sum = 0;
+  for (i=0; i<num_cons; i++) {
+     waitpid(cons[i], &x);
+     sum += x;
+  }
+  for (i=0; i<num_prods; i++) wait(0);
+  printf("End time: %d\n", uptime());
+
+  // Items left over when num_cons does not divide the total.
+  while (ring_tryget(r, &x) == 0) sum += x;
+
+  expected = 0;
+  for (i=0; i<num_prods*num_items; i++) expected += i;
+  printf("Sum consumed: %d, expected: %d\n", sum, expected);
+  shmdt(r);
+  exit(0);
+}
@@ -0,0 +1,63 @@
+// Test per-process memory accounting: touching heap pages
+// must raise rss by exactly that many pages, after fork
+// the copy-on-write pages must count as shared, and the
+// kernel stack's high-water mark must be plausible.
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/riscv.h"
+#include "kernel/procstat.h"
+#include "user/user.h"
+
+#define NPAGES 32
+
+int
+main(int argc, char *argv[])
+{
+  struct procstat before, after, child;
+  char *mem;
+  int i, pid, xstatus;
+
+  if(pinfo(-1, &before) < 0 || (mem = sbrk(2*NPAGES*PGSIZE)) == (char*)-1){
+    fprintf(2, "rsstest: pinfo or sbrk failed\n");
+    exit(1);
+  }
+  mem = (char*)PGROUNDUP((uint64)mem);
+  pinfo(-1, &after);
+  if(after.rss != before.rss){
+    fprintf(2, "rsstest: sbrk alone changed rss\n");
+    exit(1);
+  }
+  for(i = 0; i < NPAGES; i++)
+    mem[i*PGSIZE] = i;
+  pinfo(-1, &after);
+  if(after.rss - before.rss != NPAGES){
+    fprintf(2, "rsstest: rss grew by %d, not %d\n", after.rss - before.rss, NPAGES);
+    exit(1);
+  }
+  if(after.ptpages < 3){
+    fprintf(2, "rsstest: only %d page-table pages\n", after.ptpages);
+    exit(1);
+  }
+  if(after.kstack <= 0 || after.kstack > KSTACKPAGES*PGSIZE){
+    fprintf(2, "rsstest: kernel stack use %d\n", after.kstack);
+    exit(1);
+  }
+
+  if((pid = fork()) < 0){
+    fprintf(2, "rsstest: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    pinfo(-1, &child);
+    exit(child.shared - after.shared >= NPAGES ? 0 : 1);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    fprintf(2, "rsstest: child's pages not shared\n");
+    exit(1);
+  }
+
+  printf("rsstest: OK\n");
+  exit(0);
+}
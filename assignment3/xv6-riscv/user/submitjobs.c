@@ -40,7 +40,8 @@ main(int argc, char *argv[])
 	}
 	k++;
      }
-     if (forkp(atoi((const char*)prio)) == 0) exec(args[0], args);
+     if (spawn(args[0], args, atoi((const char*)prio)) < 0)
+        fprintf(2, "submitjobs: cannot run %s\n", args[0]);
   }
 
   exit(0);
@@ -0,0 +1,75 @@
+// Test swapping: several processes together touch more memory
+// than the machine has, so some of it has to go to swap and
+// come back intact, through page faults and through system
+// calls that copy to and from user memory.
+
+#include "kernel/types.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+#define NCHILD 4
+#define MB     40        // per child; NCHILD*MB > PHYSTOP-KERNBASE
+
+int
+child(int seed)
+{
+  char *mem;
+  int i, j, npages, fds[2];
+
+  npages = MB * 1024 * 1024 / PGSIZE;
+  if((mem = sbrk(npages * PGSIZE)) == (char*)-1){
+    fprintf(2, "swaptest: sbrk failed\n");
+    return 1;
+  }
+  for(i = 0; i < npages; i++){
+    ((int*)(mem + i*PGSIZE))[0] = seed + i;
+    ((int*)(mem + (i+1)*PGSIZE))[-1] = seed - i;
+  }
+
+  // two passes, so pages evicted during the first are read back.
+  for(j = 0; j < 2; j++){
+    for(i = 0; i < npages; i++){
+      if(((int*)(mem + i*PGSIZE))[0] != seed + i ||
+         ((int*)(mem + (i+1)*PGSIZE))[-1] != seed - i){
+        fprintf(2, "swaptest: page %d of child %d is wrong\n", i, seed);
+        return 1;
+      }
+    }
+  }
+
+  // the first page has likely been evicted again by now.
+  if(pipe(fds) < 0 || write(fds[1], mem, 512) != 512 ||
+     read(fds[0], mem + (npages-1)*PGSIZE, 512) != 512 ||
+     memcmp(mem, mem + (npages-1)*PGSIZE, 512) != 0){
+    fprintf(2, "swaptest: copy through pipe failed\n");
+    return 1;
+  }
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, xstatus, failed = 0;
+
+  for(i = 0; i < NCHILD; i++){
+    int pid = fork();
+    if(pid < 0){
+      fprintf(2, "swaptest: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0)
+      exit(child(i << 24));
+  }
+  for(i = 0; i < NCHILD; i++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      failed = 1;
+  }
+  if(failed){
+    printf("swaptest: FAILED\n");
+    exit(1);
+  }
+  printf("swaptest: OK\n");
+  exit(0);
+}
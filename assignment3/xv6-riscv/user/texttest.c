@@ -0,0 +1,54 @@
+// Test the shared text cache: two separate exec()s of the
+// same program must map its text at the same physical page.
+
+#include "kernel/types.h"
+#include "user/user.h"
+
+// exec this program as "texttest child", which writes the
+// physical address of main to fd.
+static int
+run(int fd)
+{
+  char *argv[] = { "texttest", "child", 0 };
+  int pid, xstatus;
+
+  if((pid = fork()) < 0)
+    return -1;
+  if(pid == 0){
+    close(1);
+    dup(fd);
+    exec("texttest", argv);
+    exit(1);
+  }
+  wait(&xstatus);
+  return xstatus;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fds[2];
+  uint64 pa1, pa2;
+
+  if(argc > 1){
+    pa1 = getpa((void*)main);
+    write(1, &pa1, sizeof(pa1));
+    exit(0);
+  }
+
+  if(pipe(fds) < 0){
+    fprintf(2, "texttest: pipe failed\n");
+    exit(1);
+  }
+  if(run(fds[1]) != 0 || read(fds[0], &pa1, sizeof(pa1)) != sizeof(pa1) ||
+     run(fds[1]) != 0 || read(fds[0], &pa2, sizeof(pa2)) != sizeof(pa2)){
+    fprintf(2, "texttest: child failed\n");
+    exit(1);
+  }
+  if(pa1 != pa2){
+    fprintf(2, "texttest: text not shared\n");
+    exit(1);
+  }
+  printf("texttest: OK\n");
+  exit(0);
+}
@@ -32,14 +32,41 @@ strlen(const char *s)
   return n;
 }
 
+// memset, memmove and memcmp move a word at a time, as
+// in kernel/string.c.
+
+typedef uint64 __attribute__((__may_alias__)) word;
+
+#define WSIZE       sizeof(word)
+#define LINE        (8*WSIZE)
+#define ALIGNED(p)  (((uint64)(p) & (WSIZE-1)) == 0)
+#define COALIGNED(p, q) ((((uint64)(p) ^ (uint64)(q)) & (WSIZE-1)) == 0)
+
 void*
 memset(void *dst, int c, uint n)
 {
-  char *cdst = (char *) dst;
-  int i;
-  for(i = 0; i < n; i++){
-    cdst[i] = c;
+  uchar *d = dst;
+  word w, *wd;
+
+  while(n > 0 && !ALIGNED(d)){
+    *d++ = c;
+    n--;
+  }
+  if(n >= WSIZE){
+    w = (uchar)c;
+    w |= w << 8;
+    w |= w << 16;
+    w |= w << 32;
+    for(wd = (word*)d; n >= LINE; n -= LINE, wd += 8){
+      wd[0] = w; wd[1] = w; wd[2] = w; wd[3] = w;
+      wd[4] = w; wd[5] = w; wd[6] = w; wd[7] = w;
+    }
+    for(; n >= WSIZE; n -= WSIZE)
+      *wd++ = w;
+    d = (uchar*)wd;
   }
+  while(n-- > 0)
+    *d++ = c;
   return dst;
 }
 
@@ -95,37 +122,104 @@ atoi(const char *s)
   return n;
 }
 
+// Copy n bytes from s to d, lowest first.
+// Safe if d is below s even when they overlap.
+static void
+copyup(uchar *d, const uchar *s, uint n)
+{
+  word *wd, a0, a1, a2, a3, a4, a5, a6, a7;
+  const word *ws;
+
+  if(COALIGNED(d, s)){
+    for(; n > 0 && !ALIGNED(d); n--)
+      *d++ = *s++;
+    wd = (word*)d;
+    ws = (const word*)s;
+    for(; n >= LINE; n -= LINE, wd += 8, ws += 8){
+      // load the line before storing any of it, in case
+      // it overlaps.
+      a0 = ws[0]; a1 = ws[1]; a2 = ws[2]; a3 = ws[3];
+      a4 = ws[4]; a5 = ws[5]; a6 = ws[6]; a7 = ws[7];
+      wd[0] = a0; wd[1] = a1; wd[2] = a2; wd[3] = a3;
+      wd[4] = a4; wd[5] = a5; wd[6] = a6; wd[7] = a7;
+    }
+    for(; n >= WSIZE; n -= WSIZE)
+      *wd++ = *ws++;
+    d = (uchar*)wd;
+    s = (const uchar*)ws;
+  }
+  while(n-- > 0)
+    *d++ = *s++;
+}
+
+// Copy the n bytes ending at s to those ending at d,
+// highest first.  Safe if d is above s even when they overlap.
+static void
+copydown(uchar *d, const uchar *s, uint n)
+{
+  word *wd, a0, a1, a2, a3, a4, a5, a6, a7;
+  const word *ws;
+
+  if(COALIGNED(d, s)){
+    for(; n > 0 && !ALIGNED(d); n--)
+      *--d = *--s;
+    wd = (word*)d;
+    ws = (const word*)s;
+    for(; n >= LINE; n -= LINE){
+      wd -= 8;
+      ws -= 8;
+      a0 = ws[0]; a1 = ws[1]; a2 = ws[2]; a3 = ws[3];
+      a4 = ws[4]; a5 = ws[5]; a6 = ws[6]; a7 = ws[7];
+      wd[0] = a0; wd[1] = a1; wd[2] = a2; wd[3] = a3;
+      wd[4] = a4; wd[5] = a5; wd[6] = a6; wd[7] = a7;
+    }
+    for(; n >= WSIZE; n -= WSIZE)
+      *--wd = *--ws;
+    d = (uchar*)wd;
+    s = (const uchar*)ws;
+  }
+  while(n-- > 0)
+    *--d = *--s;
+}
+
 void*
 memmove(void *vdst, const void *vsrc, int n)
 {
-  char *dst;
-  const char *src;
+  uchar *dst;
+  const uchar *src;
 
+  if(n <= 0)
+    return vdst;
   dst = vdst;
   src = vsrc;
-  if (src > dst) {
-    while(n-- > 0)
-      *dst++ = *src++;
-  } else {
-    dst += n;
-    src += n;
-    while(n-- > 0)
-      *--dst = *--src;
-  }
+  if(src < dst && src + n > dst)
+    copydown(dst + n, src + n, n);
+  else
+    copyup(dst, src, n);
   return vdst;
 }
 
 int
-memcmp(const void *s1, const void *s2, uint n)
+memcmp(const void *v1, const void *v2, uint n)
 {
-  const char *p1 = s1, *p2 = s2;
-  while (n-- > 0) {
-    if (*p1 != *p2) {
-      return *p1 - *p2;
-    }
-    p1++;
-    p2++;
+  const uchar *s1, *s2;
+
+  s1 = v1;
+  s2 = v2;
+  if(COALIGNED(s1, s2)){
+    for(; n > 0 && !ALIGNED(s1); n--, s1++, s2++)
+      if(*s1 != *s2)
+        return *s1 - *s2;
+    // skip the equal words; the bytes find the difference.
+    for(; n >= WSIZE && *(word*)s1 == *(word*)s2; n -= WSIZE)
+      s1 += WSIZE, s2 += WSIZE;
   }
+  while(n-- > 0){
+    if(*s1 != *s2)
+      return *s1 - *s2;
+    s1++, s2++;
+  }
+
   return 0;
 }
 
@@ -1,6 +1,8 @@
 struct stat;
 struct rtcdate;
 struct procstat;
+struct meminfo;
+struct lockstat;
 
 // system calls
 int fork(void);
@@ -33,6 +35,21 @@ int cond_consume(void);
 int buffer_sem_init(void);
 int sem_produce(int);
 int sem_consume(void);
+int bqueue_alloc(int);
+int produce_many(int, int*, int, int);
+int consume_many(int, int*, int, int);
+int bqueue_free(int);
+int shmget(int, int);
+void* shmat(int);
+int shmdt(void*);
+int futex_wait(int*, int);
+int futex_wake(int*);
+int lockdump(void);
+int lockstat(struct lockstat*, int);
+int spawn(char*, char**, int);
+void* mmap(void*, uint64, int, int, int, int);
+int munmap(void*, uint64);
+int meminfo(struct meminfo*);
 
 int getppid(void);
 int yield(void);
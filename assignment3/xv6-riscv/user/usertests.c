@@ -7,6 +7,7 @@
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
+#include "kernel/bqueue.h"
 
 //
 // Tests xv6 system calls.  usertests without arguments runs them all
@@ -724,6 +725,77 @@ exectest(char *s)
 
 }
 
+// a program file can't be written or truncated while it runs,
+// since its pages are read from the file as they are touched.
+void
+textbusy(char *s)
+{
+  char *catargv[] = { "textbusy.bin", 0 };
+  int fd, out, n, i, pid, fds[2];
+  char c;
+
+  // run a copy of cat, so a write that beats the exec
+  // harms nothing but the copy.
+  if((fd = open("cat", O_RDONLY)) < 0 ||
+     (out = open("textbusy.bin", O_CREATE|O_WRONLY)) < 0){
+    printf("%s: open failed\n", s);
+    exit(1);
+  }
+  while((n = read(fd, buf, sizeof(buf))) > 0)
+    write(out, buf, n);
+  close(fd);
+  close(out);
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if((pid = fork()) == 0){
+    close(0);
+    dup(fds[0]);
+    close(fds[0]);
+    close(fds[1]);
+    exec("textbusy.bin", catargv);
+    exit(1);
+  }
+  close(fds[0]);
+
+  // rewrite its first byte unchanged until that fails.
+  if((fd = open("textbusy.bin", O_RDONLY)) < 0 || read(fd, &c, 1) != 1){
+    printf("%s: read failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  for(i = 0; i < 100; i++){
+    if((fd = open("textbusy.bin", O_WRONLY)) < 0){
+      printf("%s: open for writing failed\n", s);
+      exit(1);
+    }
+    n = write(fd, &c, 1);
+    close(fd);
+    if(n < 0)
+      break;
+    sleep(1);
+  }
+  if(i == 100){
+    printf("%s: wrote a running program\n", s);
+    exit(1);
+  }
+  if((fd = open("textbusy.bin", O_WRONLY|O_TRUNC)) >= 0){
+    printf("%s: truncated a running program\n", s);
+    exit(1);
+  }
+
+  close(fds[1]);
+  wait(0);
+  if((fd = open("textbusy.bin", O_WRONLY|O_TRUNC)) < 0){
+    printf("%s: can't truncate once it exits\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("textbusy.bin");
+}
+
 // simple fork and pipe read/write
 
 void
@@ -779,6 +851,131 @@ pipe1(char *s)
   }
 }
 
+// several pipes open at once, so they come from the same
+// slab; each must carry its own data.
+void
+pipemany(char *s)
+{
+  enum { N=6 };
+  int fds[N][2], i;
+  char c;
+
+  for(i = 0; i < N; i++){
+    if(pipe(fds[i]) != 0){
+      printf("%s: pipe() failed\n", s);
+      exit(1);
+    }
+  }
+  for(i = 0; i < N; i++){
+    c = 'a' + i;
+    if(write(fds[i][1], &c, 1) != 1){
+      printf("%s: write to pipe %d failed\n", s, i);
+      exit(1);
+    }
+  }
+  for(i = N-1; i >= 0; i--){
+    if(read(fds[i][0], &c, 1) != 1 || c != 'a' + i){
+      printf("%s: pipe %d read wrong\n", s, i);
+      exit(1);
+    }
+    close(fds[i][0]);
+    close(fds[i][1]);
+  }
+}
+
+// shm segments that are never attached must be freed when
+// their creator exits, or the table fills up.
+void
+shmleak(char *s)
+{
+  int i, pid, xstatus;
+
+  for(i = 0; i < 100; i++){
+    if((pid = fork()) < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0)
+      exit(shmget(0, 4096) < 0 ? 1 : 0);
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("%s: shmget failed after %d segments\n", s, i);
+      exit(1);
+    }
+  }
+}
+
+// an id for a segment freed when its creator exited must not
+// attach a new segment that reuses its slot.
+void
+shmstale(char *s)
+{
+  int id, id2, pid, xstatus;
+  char *va;
+
+  if((pid = fork()) < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0)
+    exit(shmget(0x5157, 4096));
+  wait(&id);
+  if(id < 0){
+    printf("%s: shmget failed\n", s);
+    exit(1);
+  }
+  if((id2 = shmget(0, 4096)) < 0){
+    printf("%s: shmget failed\n", s);
+    exit(1);
+  }
+  if((pid = fork()) == 0)
+    exit(shmat(id) == (void*)-1 ? 0 : 1);
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: stale shm id %d attached\n", s, id);
+    exit(1);
+  }
+  if((va = shmat(id2)) == (char*)-1){
+    printf("%s: shmat failed\n", s);
+    exit(1);
+  }
+  shmdt(va);
+}
+
+// produce_many() whose source runs into an unmapped page
+// must report the items it did queue.
+void
+bqpartial(char *s)
+{
+  int q, pad, items[3], *top;
+  char *end;
+
+  if((q = bqueue_alloc(4)) < 0){
+    printf("%s: bqueue_alloc failed\n", s);
+    exit(1);
+  }
+  // move the ring's tail to its last slot, so that the
+  // next produce copies in two spans.
+  if(produce_many(q, items, 3, 0) != 3 || consume_many(q, items, 3, 0) != 3){
+    printf("%s: setup failed\n", s);
+    exit(1);
+  }
+  // the last int below a page-aligned end of the heap.
+  end = sbrk(0);
+  pad = PGROUNDUP((uint64)end) - (uint64)end;
+  sbrk(pad);
+  top = (int*)(end + pad) - 1;
+  *top = 7;
+  if(produce_many(q, top, 2, BQ_NONBLOCK) != 1){
+    printf("%s: partial produce not reported\n", s);
+    exit(1);
+  }
+  if(consume_many(q, items, 3, BQ_NONBLOCK) != 1 || items[0] != 7){
+    printf("%s: wrong items queued\n", s);
+    exit(1);
+  }
+  bqueue_free(q);
+}
 
 // test if child is killed (status = -1)
 void
@@ -2046,7 +2243,7 @@ iref(char *s)
 void
 forktest(char *s)
 {
-  enum{ N = 1000 };
+  enum{ N = 5000 };  // more than NPROC
   int n, pid;
 
   for(n=0; n<N; n++){
@@ -2063,7 +2260,7 @@ forktest(char *s)
   }
 
   if(n == N){
-    printf("%s: fork claimed to work 1000 times!\n", s);
+    printf("%s: fork claimed to work %d times!\n", s, N);
     exit(1);
   }
 
@@ -2850,6 +3047,7 @@ main(int argc, char *argv[])
     {sharedfd, "sharedfd"},
     {dirtest, "dirtest"},
     {exectest, "exectest"},
+    {textbusy, "textbusy"},
     {bigargtest, "bigargtest"},
     {bigwrite, "bigwrite"},
     {bsstest, "bsstest"},
@@ -2871,6 +3069,10 @@ main(int argc, char *argv[])
     {iputtest, "iput"},
     {mem, "mem"},
     {pipe1, "pipe1"},
+    {pipemany, "pipemany"},
+    {shmleak, "shmleak"},
+    {shmstale, "shmstale"},
+    {bqpartial, "bqpartial"},
     {killstatus, "killstatus"},
     {preempt, "preempt"},
     {exitwait, "exitwait"},
@@ -56,3 +56,18 @@ entry("cond_consume");
 entry("buffer_sem_init");
 entry("sem_produce");
 entry("sem_consume");
+entry("bqueue_alloc");
+entry("produce_many");
+entry("consume_many");
+entry("bqueue_free");
+entry("shmget");
+entry("shmat");
+entry("shmdt");
+entry("futex_wait");
+entry("futex_wake");
+entry("lockdump");
+entry("lockstat");
+entry("spawn");
+entry("mmap");
+entry("munmap");
+entry("meminfo");